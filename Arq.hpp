@@ -0,0 +1,358 @@
+#pragma once
+
+/*
+ * Selective-repeat ARQ: frames are numbered, the receiver acknowledges them
+ * and puts them back in order, the sender retransmits only those lost.
+ *
+ * An acknowledgement carries the next sequence the receiver will deliver and
+ * a bitmap of the frames it holds from there on (waiting for an earlier one,
+ * or for room in the receive queue).  Held frames are never discarded, so
+ * the sender frees a frame only once it is cumulatively acknowledged, but
+ * does not resend it while it is marked held.  A frame is resent when a
+ * frame sent after it is held (serial links do not reorder, so it was
+ * lost), or when its retransmission timeout expires.  The timeout follows
+ * the measured round trip time (RFC 6298, samples from frames sent once).
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <vector>
+
+namespace Arq {
+
+using Clock = std::chrono::steady_clock;
+
+/* Most frames in flight, covered by the acknowledgement bitmap; under half the sequence space */
+static constexpr std::size_t max_window = 32;
+
+/* Acknowledgement: next sequence, bitmap size, bitmap */
+static constexpr std::size_t max_ack = 2 + max_window / 8;
+
+/* Retransmission timeout before the first round trip is measured, and its ceiling (raised to min_rto on slow links) */
+static constexpr auto initial_rto = std::chrono::seconds(1);
+static constexpr auto max_rto = std::chrono::seconds(4);
+
+struct Ack
+{
+	/* Frames before this have been delivered */
+	std::uint8_t next{0};
+	/* Bit i: frame next + i is held by the receiver */
+	std::uint32_t held{0};
+
+	/* Writes acknowledgement (at most max_ack bytes), returns its size */
+	std::size_t store(std::uint8_t *out) const
+	{
+		std::size_t count = 0;
+		while (count < 4 && held >> 8 * count) {
+			count++;
+		}
+		out[0] = next;
+		out[1] = count;
+		for (std::size_t i = 0; i < count; i++) {
+			out[2 + i] = held >> 8 * i;
+		}
+		return 2 + count;
+	}
+
+	/* Reads acknowledgement, returns its size, zero if malformed */
+	std::size_t load(const std::uint8_t *in, std::size_t size)
+	{
+		if (size < 2 || in[1] > 4 || size < 2u + in[1]) {
+			return 0;
+		}
+		next = in[0];
+		held = 0;
+		for (std::size_t i = 0; i < in[1]; i++) {
+			held |= std::uint32_t(in[2 + i]) << 8 * i;
+		}
+		return 2 + in[1];
+	}
+};
+
+class Sender
+{
+	struct Slot
+	{
+		std::vector<std::uint8_t> data;
+		std::size_t size{0};
+		Clock::time_point sent;
+		unsigned transmissions{0};
+		bool held{false};
+	};
+
+	std::vector<Slot> slots;
+	std::size_t window;
+	/* Oldest unacknowledged frame, and next to be numbered */
+	std::uint8_t base{0};
+	std::uint8_t next{0};
+
+	Clock::duration min_rto;
+	Clock::duration rto;
+	std::optional<Clock::duration> srtt;
+	Clock::duration rttvar{0};
+
+	Slot& slot(std::uint8_t seq)
+	{
+		return slots[seq % max_window];
+	}
+
+	Clock::duration ceiling() const
+	{
+		return std::max<Clock::duration>(max_rto, 2 * min_rto);
+	}
+
+	void sample_rtt(Clock::duration rtt)
+	{
+		/* RFC 6298 */
+		if (!srtt) {
+			srtt = rtt;
+			rttvar = rtt / 2;
+		} else {
+			const auto error = *srtt > rtt ? *srtt - rtt : rtt - *srtt;
+			rttvar = (3 * rttvar + error) / 4;
+			srtt = (7 * *srtt + rtt) / 8;
+		}
+		rto = std::clamp<Clock::duration>(*srtt + 4 * rttvar, min_rto, ceiling());
+	}
+
+public:
+	/* window at most max_window, slot_size is the largest frame */
+	Sender(std::size_t window, std::size_t slot_size, Clock::duration min_rto) :
+		slots(max_window),
+		window(window),
+		min_rto(min_rto),
+		rto(std::max<Clock::duration>(initial_rto, min_rto))
+	{
+		for (auto& slot : slots) {
+			slot.data.resize(slot_size);
+		}
+	}
+
+	/* Forgets all frames, numbering restarts from zero */
+	void reset()
+	{
+		base = 0;
+		next = 0;
+		for (auto& slot : slots) {
+			slot.transmissions = 0;
+			slot.held = false;
+		}
+	}
+
+	std::size_t outstanding() const
+	{
+		return std::uint8_t(next - base);
+	}
+
+	std::size_t space() const
+	{
+		return window - outstanding();
+	}
+
+	Clock::duration get_rto() const
+	{
+		return rto;
+	}
+
+	/* Numbers and keeps frame (from a header and payload) for transmission, returns its sequence */
+	std::uint8_t push(const void *header, std::size_t header_size, const void *data, std::size_t size)
+	{
+		auto& s = slot(next);
+		std::memcpy(s.data.data(), header, header_size);
+		std::memcpy(s.data.data() + header_size, data, size);
+		s.size = header_size + size;
+		s.transmissions = 0;
+		s.held = false;
+		return next++;
+	}
+
+	const std::uint8_t *data(std::uint8_t seq)
+	{
+		return slot(seq).data.data();
+	}
+
+	std::size_t size(std::uint8_t seq)
+	{
+		return slot(seq).size;
+	}
+
+	void sent(std::uint8_t seq, Clock::time_point now)
+	{
+		auto& s = slot(seq);
+		s.sent = now;
+		s.transmissions++;
+	}
+
+	/* Applies acknowledgement, returns the newest round trip time measured by it, if any */
+	std::optional<Clock::duration> acknowledge(const Ack& ack, Clock::time_point now)
+	{
+		std::optional<Clock::duration> rtt;
+		const std::size_t delivered = std::uint8_t(ack.next - base);
+		if (delivered > outstanding()) {
+			/* Stale, or from before a reset */
+			return rtt;
+		}
+		const auto measure = [&] (Slot& s) {
+			if (s.transmissions == 1 && !s.held) {
+				rtt = now - s.sent;
+			}
+		};
+		for (std::size_t i = 0; i < delivered; i++) {
+			auto& s = slot(base + i);
+			measure(s);
+			s.transmissions = 0;
+			s.held = false;
+		}
+		base = ack.next;
+		for (std::size_t i = 0; i < outstanding() && i < max_window; i++) {
+			if (ack.held >> i & 1) {
+				auto& s = slot(base + i);
+				measure(s);
+				s.held = true;
+			}
+		}
+		if (rtt) {
+			sample_rtt(*rtt);
+		}
+		return rtt;
+	}
+
+	/* Calls f(seq) for each frame which a later, held frame shows was lost */
+	template <typename F>
+	void for_each_lost(F&& f)
+	{
+		std::optional<Clock::time_point> latest;
+		for (std::size_t i = outstanding(); i-- > 0; ) {
+			auto& s = slot(base + i);
+			if (s.held) {
+				latest = std::max(latest.value_or(s.sent), s.sent);
+			} else if (latest && s.sent < *latest) {
+				f(std::uint8_t(base + i));
+			}
+		}
+	}
+
+	/* Calls f(seq) for each frame whose timeout has expired, backing off the timeout if any */
+	template <typename F>
+	void for_each_expired(Clock::time_point now, F&& f)
+	{
+		bool expired = false;
+		for (std::size_t i = 0; i < outstanding(); i++) {
+			auto& s = slot(base + i);
+			if (!s.held && s.sent + rto <= now) {
+				expired = true;
+				f(std::uint8_t(base + i));
+			}
+		}
+		if (expired) {
+			rto = std::min<Clock::duration>(2 * rto, ceiling());
+		}
+	}
+
+	/* When the next timeout expires, if anything is awaiting acknowledgement */
+	std::optional<Clock::time_point> deadline()
+	{
+		std::optional<Clock::time_point> earliest;
+		for (std::size_t i = 0; i < outstanding(); i++) {
+			auto& s = slot(base + i);
+			if (!s.held) {
+				earliest = std::min(earliest.value_or(s.sent), s.sent);
+			}
+		}
+		if (earliest) {
+			*earliest += rto;
+		}
+		return earliest;
+	}
+};
+
+class Receiver
+{
+	struct Slot
+	{
+		std::vector<std::uint8_t> data;
+		std::size_t size{0};
+		bool filled{false};
+	};
+
+	std::vector<Slot> slots;
+	std::uint8_t next{0};
+
+	Slot& slot(std::uint8_t seq)
+	{
+		return slots[seq % max_window];
+	}
+
+public:
+	enum Result
+	{
+		/* Next in order */
+		accepted,
+		/* Held until the frames before it arrive */
+		early,
+		/* Already held or delivered */
+		duplicate
+	};
+
+	explicit Receiver(std::size_t slot_size) :
+		slots(max_window)
+	{
+		for (auto& slot : slots) {
+			slot.data.resize(slot_size);
+		}
+	}
+
+	void reset()
+	{
+		next = 0;
+		for (auto& slot : slots) {
+			slot.filled = false;
+		}
+	}
+
+	/* Holds frame (size at most slot_size) until it can be delivered in order */
+	Result receive(std::uint8_t seq, const void *data, std::size_t size)
+	{
+		const std::size_t offset = std::uint8_t(seq - next);
+		if (offset >= max_window) {
+			/* Behind the window: the sender missed our acknowledgement */
+			return duplicate;
+		}
+		auto& s = slot(seq);
+		if (s.filled) {
+			return duplicate;
+		}
+		std::memcpy(s.data.data(), data, size);
+		s.size = size;
+		s.filled = true;
+		return offset == 0 ? accepted : early;
+	}
+
+	/* Passes frames which are now in order to deliver(data, size), until it returns false */
+	template <typename F>
+	void release(F&& deliver)
+	{
+		for (auto *s = &slot(next); s->filled && deliver(s->data.data(), s->size); s = &slot(next)) {
+			s->filled = false;
+			next++;
+		}
+	}
+
+	Ack ack()
+	{
+		Ack ack;
+		ack.next = next;
+		for (std::size_t i = 0; i < max_window; i++) {
+			if (slot(next + i).filled) {
+				ack.held |= std::uint32_t(1) << i;
+			}
+		}
+		return ack;
+	}
+};
+
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+/*
+ * Byte FIFO backed by a "magic" ring buffer: the same memfd pages are mapped
+ * twice, back to back, so the readable and writable regions are always
+ * contiguous in virtual memory regardless of wrap-around.  Producers encode
+ * straight into write_data(), consumers write(2) straight from read_data().
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+#include <sys/mman.h>
+
+#include "Linux.hpp"
+
+class ByteRing
+{
+	std::size_t capacity;
+	std::uint8_t *base{nullptr};
+
+	/* Free-running positions, offset into buffer is modulo capacity */
+	std::size_t read_pos{0};
+	std::size_t write_pos{0};
+
+	static std::size_t round_to_pages(std::size_t size)
+	{
+		const std::size_t page = sysconf(_SC_PAGESIZE);
+		return (size + page - 1) / page * page;
+	}
+
+public:
+	explicit ByteRing(std::size_t min_capacity) :
+		capacity(round_to_pages(min_capacity))
+	{
+		Linux::FileDescriptor fd(memfd_create("ByteRing", MFD_CLOEXEC), "memfd_create");
+		Linux::detail::assert_zero("ftruncate", ftruncate(fd.get_fd(), capacity));
+		/* Reserve address space for both views, then map the pages into each half */
+		void *p = mmap(nullptr, 2 * capacity, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED) {
+			throw Linux::SysCallFailed("mmap");
+		}
+		base = static_cast<std::uint8_t *>(p);
+		for (int i = 0; i < 2; i++) {
+			if (mmap(base + i * capacity, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd.get_fd(), 0) == MAP_FAILED) {
+				munmap(base, 2 * capacity);
+				throw Linux::SysCallFailed("mmap");
+			}
+		}
+	}
+
+	ByteRing(const ByteRing&) = delete;
+	void operator = (const ByteRing&) = delete;
+
+	~ByteRing()
+	{
+		munmap(base, 2 * capacity);
+	}
+
+	bool empty() const
+	{
+		return read_pos == write_pos;
+	}
+
+	/* Bytes queued */
+	std::size_t size() const
+	{
+		return write_pos - read_pos;
+	}
+
+	/* Bytes which can be written */
+	std::size_t space() const
+	{
+		return capacity - size();
+	}
+
+	void clear()
+	{
+		read_pos = write_pos = 0;
+	}
+
+	/* Contiguous region of space() bytes */
+	std::uint8_t *write_data()
+	{
+		return base + write_pos % capacity;
+	}
+
+	void commit(std::size_t size)
+	{
+		write_pos += size;
+	}
+
+	/* Contiguous region of size() bytes */
+	const std::uint8_t *read_data() const
+	{
+		return base + read_pos % capacity;
+	}
+
+	void consume(std::size_t size)
+	{
+		read_pos += size;
+		if (read_pos == write_pos) {
+			clear();
+		}
+	}
+};
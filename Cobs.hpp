@@ -0,0 +1,301 @@
+#pragma once
+
+/*
+ * Implementation of COBS (Consistent Overhead Byte Stuffing) coding scheme,
+ * for serialising/deserialising packets over a serial character link.
+ *
+ * Same interface as the KISS coder, but overhead is bounded regardless of
+ * payload content: one code byte per 254 bytes of payload, plus delimiters.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <vector>
+#include <list>
+
+namespace Cobs {
+
+struct Config
+{
+	static constexpr std::uint8_t DELIM = 0x00;
+	/* Code byte for a full block which is not followed by a zero */
+	static constexpr std::uint8_t FULL = 0xff;
+	static constexpr std::size_t BLOCK = FULL - 1;
+};
+
+class Encoder
+{
+	static constexpr std::size_t fused_chunk = 512;
+
+	/* Current block, held back until its code byte is known */
+	std::array<std::uint8_t, Config::BLOCK> block;
+	std::size_t block_len = 0;
+
+	template <typename OutputIt>
+	OutputIt flush(OutputIt oit)
+	{
+		*oit++ = std::uint8_t(block_len + 1);
+		oit = std::copy(block.cbegin(), block.cbegin() + block_len, oit);
+		block_len = 0;
+		return oit;
+	}
+
+public:
+	/* Worst-case size of a frame holding len bytes (including delimiters) */
+	static constexpr std::size_t max_frame_length(std::size_t len)
+	{
+		return len + len / Config::BLOCK + 1 + 2;
+	}
+
+	/* Worst-case size of a frame holding the lead byte, buffer and tail_len more bytes, COBS overhead hardly varies */
+	static constexpr std::size_t frame_length(std::uint8_t, const void *, std::size_t len, std::size_t tail_len)
+	{
+		return max_frame_length(1 + len + tail_len);
+	}
+
+	template <typename OutputIt>
+	OutputIt open(OutputIt oit)
+	{
+		block_len = 0;
+		*oit++ = Config::DELIM;
+		return oit;
+	}
+
+	template <typename OutputIt>
+	OutputIt close(OutputIt oit)
+	{
+		oit = flush(oit);
+		*oit++ = Config::DELIM;
+		return oit;
+	}
+
+	template <typename InputIt, typename OutputIt>
+	OutputIt write(InputIt begin, InputIt end, OutputIt oit)
+	{
+		for (InputIt& it = begin; it != end; ++it) {
+			const std::uint8_t byte = *it;
+			if (byte == Config::DELIM) {
+				oit = flush(oit);
+			} else {
+				block[block_len++] = byte;
+				if (block_len == Config::BLOCK) {
+					oit = flush(oit);
+				}
+			}
+		}
+		return oit;
+	}
+
+	template <typename OutputIt>
+	OutputIt write(const void *buf, std::size_t len, OutputIt oit)
+	{
+		/* Copy runs between zeroes into the block in bulk */
+		const std::uint8_t *p = static_cast<const std::uint8_t *>(buf);
+		const std::uint8_t *end = p + len;
+		while (p != end) {
+			const auto room = std::min<std::size_t>(end - p, Config::BLOCK - block_len);
+			const void *zero = std::memchr(p, Config::DELIM, room);
+			const auto run = zero ? static_cast<const std::uint8_t *>(zero) - p : room;
+			std::memcpy(&block[block_len], p, run);
+			block_len += run;
+			p += run;
+			if (zero) {
+				oit = flush(oit);
+				p++;
+			} else if (block_len == Config::BLOCK) {
+				oit = flush(oit);
+			}
+		}
+		return oit;
+	}
+
+	/*
+	 * Fused pass: observer(data, size) sees each chunk of input just before
+	 * it is encoded, while it is still hot in cache
+	 */
+	template <typename OutputIt, typename Observer>
+	OutputIt write(const void *buf, std::size_t len, OutputIt oit, Observer&& observer)
+	{
+		const std::uint8_t *p = static_cast<const std::uint8_t *>(buf);
+		while (len > 0) {
+			const auto chunk = std::min<std::size_t>(len, fused_chunk);
+			observer(p, chunk);
+			oit = write(p, chunk, oit);
+			p += chunk;
+			len -= chunk;
+		}
+		return oit;
+	}
+};
+
+/* Decoder observer which ignores everything */
+struct NullObserver
+{
+	void start()
+	{
+	}
+	void update(const std::uint8_t *, std::size_t)
+	{
+	}
+};
+
+class Decoder
+{
+	std::size_t max_packet_length;
+
+	/* Reserved once, reused for every frame */
+	std::vector<std::uint8_t> packet;
+
+	enum State {
+		idle,
+		error,
+		active
+	};
+	State state = idle;
+
+	/* Data bytes left in current block */
+	std::size_t remaining = 0;
+	/* Whether current block is followed by a zero (unless frame ends) */
+	bool pending_zero = false;
+
+	template <typename Observer>
+	bool append(const std::uint8_t *data, std::size_t size, Observer& observer)
+	{
+		if (packet.size() + size > max_packet_length) {
+			state = error;
+			return false;
+		}
+		packet.insert(packet.end(), data, data + size);
+		observer.update(static_cast<const std::uint8_t *>(packet.data()), packet.size());
+		return true;
+	}
+
+	/*
+	 * Sink is called as sink(const std::uint8_t *data, std::size_t size) for
+	 * each complete packet, the range is only valid for the duration of the
+	 * call
+	 */
+	template <typename Sink, typename Observer>
+	void step(const std::uint8_t in, Sink& sink, Observer& observer)
+	{
+		if (in == Config::DELIM) {
+			/* End of frame, discard it if a block was truncated */
+			if (state == active && remaining == 0) {
+				sink(static_cast<const std::uint8_t *>(packet.data()), packet.size());
+			}
+			state = idle;
+			return;
+		}
+		if (state == error) {
+			return;
+		}
+		if (state == idle) {
+			state = active;
+			packet.clear();
+			observer.start();
+			remaining = 0;
+			pending_zero = false;
+		}
+		if (remaining == 0) {
+			/* Code byte */
+			const std::uint8_t zero = 0;
+			if (pending_zero && !append(&zero, 1, observer)) {
+				return;
+			}
+			remaining = in - 1;
+			pending_zero = in != Config::FULL;
+		} else {
+			append(&in, 1, observer);
+			remaining--;
+		}
+	}
+
+	template <typename InputIt, typename Sink, typename Observer>
+	void decode_internal(InputIt begin, InputIt end, Sink& sink, Observer& observer)
+	{
+		for (InputIt& it = begin; it != end; ++it) {
+			step(*it, sink, observer);
+		}
+	}
+
+	/* Contiguous fast path: block contents are copied in bulk */
+	template <typename Sink, typename Observer>
+	void decode_contiguous(const std::uint8_t *p, const std::uint8_t *end, Sink& sink, Observer& observer)
+	{
+		while (p != end) {
+			if (state == active && remaining > 0 && *p != Config::DELIM) {
+				const auto limit = std::min<std::size_t>(end - p, remaining);
+				const void *delim = std::memchr(p, Config::DELIM, limit);
+				const auto run = delim ? static_cast<const std::uint8_t *>(delim) - p : limit;
+				if (append(p, run, observer)) {
+					remaining -= run;
+				}
+				p += run;
+				continue;
+			} else if (state == error) {
+				const void *delim = std::memchr(p, Config::DELIM, end - p);
+				if (delim == nullptr) {
+					break;
+				}
+				p = static_cast<const std::uint8_t *>(delim);
+			}
+			step(*p++, sink, observer);
+		}
+	}
+
+public:
+	Decoder(std::size_t max_packet_length) :
+		max_packet_length(max_packet_length)
+	{
+		packet.reserve(max_packet_length);
+	}
+
+	/*
+	 * Streaming decode, no allocation: each packet is passed to sink.
+	 *
+	 * Observer (optional) sees the packet as it is built: observer.start()
+	 * at the beginning of each frame and observer.update(data, size) with
+	 * the whole packet so far each time bytes are added to it.
+	 */
+	template <typename InputIt, typename Sink, typename Observer>
+	void decode(InputIt begin, InputIt end, Sink&& sink, Observer& observer)
+	{
+		decode_internal(begin, end, sink, observer);
+	}
+
+	template <typename Sink, typename Observer>
+	void decode(const std::uint8_t *begin, const std::uint8_t *end, Sink&& sink, Observer& observer)
+	{
+		decode_contiguous(begin, end, sink, observer);
+	}
+
+	template <typename InputIt, typename Sink>
+	void decode(InputIt begin, InputIt end, Sink&& sink)
+	{
+		NullObserver observer;
+		decode(begin, end, sink, observer);
+	}
+
+	template <typename InputIt>
+	std::list<std::vector<std::uint8_t>> decode(InputIt begin, InputIt end)
+	{
+		std::list<std::vector<std::uint8_t>> packets;
+		auto sink = [&packets] (const std::uint8_t *data, std::size_t size) {
+			packets.emplace_back(data, data + size);
+		};
+		NullObserver observer;
+		decode_internal(begin, end, sink, observer);
+		return packets;
+	}
+
+	template <typename Container>
+	std::list<std::vector<std::uint8_t>> decode(const Container& container)
+	{
+		return decode(container.cbegin(), container.cend());
+	}
+};
+
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+/*
+ * CoDel active queue management (RFC 8289), applied at dequeue time to a
+ * TxQueue.  Once packets have been waiting longer than target for a whole
+ * interval, the head packet is dropped (or ECN-marked by the caller) at an
+ * increasing rate until the standing queue has gone.
+ */
+
+#include <cmath>
+#include <chrono>
+
+#include "TxQueue.hpp"
+
+class Codel
+{
+public:
+	using Clock = TxQueue::Clock;
+	using Duration = Clock::duration;
+
+	enum Verdict {
+		pass,
+		drop
+	};
+
+private:
+	Duration target;
+	Duration interval;
+	/* Below this backlog the queue is never considered standing */
+	std::size_t min_bytes;
+
+	bool dropping{false};
+	unsigned count{0};
+	unsigned last_count{0};
+	Clock::time_point first_above;
+	Clock::time_point drop_next;
+
+	Clock::time_point control_law(Clock::time_point t) const
+	{
+		return t + std::chrono::duration_cast<Duration>(interval / std::sqrt(double(count)));
+	}
+
+	bool ok_to_drop(const TxQueue& queue, Clock::time_point now)
+	{
+		if (now - queue.front().enqueued < target || queue.size_bytes() <= min_bytes) {
+			first_above = {};
+			return false;
+		}
+		if (first_above == Clock::time_point{}) {
+			first_above = now + interval;
+			return false;
+		}
+		return now >= first_above;
+	}
+
+public:
+	Codel(Duration target, Duration interval, std::size_t min_bytes) :
+		target(target),
+		interval(interval),
+		min_bytes(min_bytes)
+	{
+	}
+
+	/*
+	 * Decides fate of queue.front() (queue must not be empty), caller then
+	 * removes it from the queue and sends it, marks it or drops it
+	 */
+	Verdict dequeue(const TxQueue& queue, Clock::time_point now)
+	{
+		const bool ok = ok_to_drop(queue, now);
+		if (dropping) {
+			if (!ok) {
+				dropping = false;
+			} else if (now >= drop_next) {
+				count++;
+				drop_next = control_law(drop_next);
+				return drop;
+			}
+			return pass;
+		}
+		if (ok) {
+			dropping = true;
+			/* Resume near the previous drop rate if we were dropping recently */
+			const unsigned delta = count - last_count;
+			count = delta > 1 && now - drop_next < 16 * interval ? delta : 1;
+			last_count = count;
+			drop_next = control_law(now);
+			return drop;
+		}
+		return pass;
+	}
+
+	/* Leave dropping state when the queue runs empty */
+	void idle()
+	{
+		dropping = false;
+		first_above = {};
+	}
+};
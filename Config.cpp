@@ -1,5 +1,8 @@
 #define KEEP_X_CONFIG
 #include "Config.hpp"
+#include "Lz.hpp"
+#include "ReedSolomon.hpp"
+#include "Arq.hpp"
 
 namespace IpLink {
 
@@ -29,6 +32,22 @@ static int strtonatural(const string& s)
 	return ret;
 }
 
+static string strtoframing(const string& s)
+{
+	if (s != "kiss" && s != "cobs") {
+		throw Config::parse_error("Invalid framing: " + s);
+	}
+	return s;
+}
+
+static string strtochecksum(const string& s)
+{
+	if (s != "legacy" && s != "crc32c" && s != "none") {
+		throw Config::parse_error("Invalid checksum: " + s);
+	}
+	return s;
+}
+
 void Config::set(const string& key, const string& value)
 {
 	if (0) {
@@ -144,6 +163,21 @@ void Config::validate() const
 	if (updown && keepalive_interval <= 0) {
 		throw std::runtime_error("Invalid arguments: \"updown\" requires keepalives to be enabled");
 	}
+	if (fec_parity > int(ReedSolomon::max_parity)) {
+		throw std::runtime_error("Invalid arguments: \"fec_parity\" is out of range");
+	}
+	if (compression > Lz::max_level) {
+		throw std::runtime_error("Invalid arguments: \"compression\" level is out of range");
+	}
+	if (compression_stream && compression == 0) {
+		throw std::runtime_error("Invalid arguments: \"compression_stream\" requires a compression level");
+	}
+	if (arq_window < 1 || arq_window > int(Arq::max_window)) {
+		throw std::runtime_error("Invalid arguments: \"arq_window\" is out of range");
+	}
+	if (aggregate_linger_us >= 1000) {
+		throw std::runtime_error("Invalid arguments: \"aggregate_linger_us\" must be under a millisecond");
+	}
 }
 
 }
@@ -17,11 +17,27 @@ namespace IpLink {
 		X(baud, int, 115200, strtonatural, std::to_string, "Serial baud rate") \
 		X(ifname, string, "uart0", string, string, "TUN interface name") \
 		X(mtu, int, 115200/32, strtonatural, std::to_string, "Interface MTU") \
+		X(tun_no_pi, bool, false, strtobool, booltostr, "Open TUN without packet information header (IFF_NO_PI); independent of the peer") \
+		X(framing, string, "kiss", strtoframing, string, "Serial framing: kiss (KISS/SLIP escaping) or cobs (consistent overhead byte stuffing), must match peer") \
+		X(checksum, string, "legacy", strtochecksum, string, "Frame check: legacy (rotating checksum), crc32c (hardware accelerated where available) or none (for transports which are already reliable), must match peer") \
+		X(fec_parity, int, 0, strtonatural, std::to_string, "Reed-Solomon parity bytes per block of up to 255 bytes, each block then survives half as many corrupted bytes (zero for off, up to 64), must match peer") \
+		X(uart_queue_ms, int, 10, strtonatural, std::to_string, "Data to keep queued in the serial driver, in milliseconds of line time (lower gives faster prioritisation, higher tolerates more scheduling jitter)") \
+		X(tx_rate, int, 0, strtonatural, std::to_string, "Transmit rate cap in bits per second, for duty-cycle limited radios (zero for line rate)") \
+		X(header_compression, bool, true, strtobool, booltostr, "Compress TCP/IP (RFC 1144) and UDP/IP headers when the peer supports it") \
+		X(compression, int, 0, strtonatural, std::to_string, "Frame compression level: 0 (off) to 3 (best), eased off while the transmit queue is shallow; used only if the peer supports it") \
+		X(compression_stream, bool, false, strtobool, booltostr, "Compress each frame against earlier ones (restarted when frames are lost), if the peer supports it and has the same dictionary") \
+		X(dictionary, string, "", string, string, "File to prime the stream compression history with, typical traffic (empty for none)") \
+		X(aggregate, bool, true, strtobool, booltostr, "Send packets queued together as one frame under a single checksum, if the peer supports it") \
+		X(aggregate_linger_us, int, 0, strtonatural, std::to_string, "Microseconds to hold a partly filled aggregate frame for more packets (zero to send at once, must be under a millisecond)") \
+		X(fragment_ms, int, 20, strtonatural, std::to_string, "Split bulk packets which would hold the line longer than this many milliseconds into fragments, so higher priority frames can go out between them (zero for off); used only if the peer supports it") \
+		X(arq, bool, false, strtobool, booltostr, "Acknowledge frames and retransmit lost ones at the link layer (selective repeat), delivering them in order; used only if the peer supports it") \
+		X(arq_window, int, 16, strtonatural, std::to_string, "Frames sent ahead of acknowledgement when retransmitting (1 to 32)") \
 		X(addr, ip_address, "10.101.0.1/30", ip_address, std::to_string, "Local IP address") \
 		X(keepalive_interval, int, 500, strtonatural, std::to_string, "Keep-alive interval in milliseconds (zero to disable)") \
 		X(keepalive_limit, int, 3, strtonatural, std::to_string, "Number of missed keep-alive messages before assuming peer has disconnected (limit must be greater than one if enabled)") \
 		X(updown, bool, false, strtobool, booltostr, "Set TUN up/down in response to peer connection/disconnection (requires keep-alives to be enabled)") \
 		X(daemon, bool, false, strtobool, booltostr, "Fork to background") \
+		X(edge_triggered, bool, false, strtobool, booltostr, "Use edge-triggered epoll and drain descriptors, instead of updating interest masks as queues fill and empty") \
 		X(verbose, bool, false, strtobool, booltostr, "Enable extra logging") \
 		X(meter, bool, false, strtobool, booltostr, "Display data meter")
 
@@ -0,0 +1,168 @@
+#pragma once
+
+/*
+ * Per-flow fair queueing: packets are hashed into flow queues, which are
+ * served by deficit round robin weighted in bytes, so that one bulk flow
+ * cannot starve the others.  Each flow has its own CoDel state (as in
+ * fq_codel), applied by the caller when it serves the flow.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <ostream>
+
+#include "TxQueue.hpp"
+#include "Codel.hpp"
+
+class FairQueue
+{
+public:
+	struct Flow
+	{
+		TxQueue queue;
+		Codel codel;
+		/* Bytes this flow may still send in the current round */
+		long deficit;
+		bool active;
+	};
+
+private:
+	std::vector<Flow> flows;
+	/* Flows with packets queued, in service order */
+	std::deque<Flow *> active;
+	std::size_t quantum;
+	std::size_t limit;
+	std::size_t bytes{0};
+
+	void deactivate(Flow& flow)
+	{
+		flow.active = false;
+		flow.deficit = 0;
+		flow.codel.idle();
+	}
+
+	Flow *fattest()
+	{
+		Flow *result = nullptr;
+		for (auto flow : active) {
+			if (!result || flow->queue.size_bytes() > result->queue.size_bytes()) {
+				result = flow;
+			}
+		}
+		return result;
+	}
+
+public:
+	FairQueue(std::size_t flow_count, std::size_t quantum, std::size_t limit, const Codel& codel) :
+		flows(flow_count, Flow{ TxQueue(limit), codel, 0, false }),
+		quantum(quantum),
+		limit(limit)
+	{
+	}
+
+	FairQueue(const FairQueue&) = delete;
+	void operator = (const FairQueue&) = delete;
+
+	bool empty() const
+	{
+		return active.empty();
+	}
+
+	/* Payload bytes queued, over all flows */
+	std::size_t size_bytes() const
+	{
+		return bytes;
+	}
+
+	/*
+	 * Queues the frame in the flow selected by hash.  When full,
+	 * room is made by dropping from the head of the longest flow (or the
+	 * new frame is dropped, if that is its own flow).  Returns the number of
+	 * frames dropped.
+	 */
+	std::size_t push(std::uint32_t hash, std::uint8_t frame_type, PacketPool::Buffer&& data)
+	{
+		const auto size = data.size();
+		Flow& flow = flows[hash % flows.size()];
+		std::size_t dropped = 0;
+		while (bytes + size > limit && !active.empty()) {
+			Flow *victim = fattest();
+			if (victim == &flow) {
+				return dropped + 1;
+			}
+			pop(*victim);
+			dropped++;
+		}
+		flow.queue.push(frame_type, std::move(data));
+		bytes += size;
+		if (!flow.active) {
+			flow.active = true;
+			flow.deficit = quantum;
+			active.push_back(&flow);
+		}
+		return dropped;
+	}
+
+	/*
+	 * Flow to serve next, or nullptr if empty.  Caller sends or drops the
+	 * frame at the head of the flow's queue, then calls pop or drop.
+	 */
+	Flow *next()
+	{
+		while (!active.empty()) {
+			Flow *flow = active.front();
+			if (flow->deficit > 0) {
+				return flow;
+			}
+			/* Used up its share for this round, go to the back */
+			flow->deficit += quantum;
+			active.pop_front();
+			active.push_back(flow);
+		}
+		return nullptr;
+	}
+
+	/* Removes the head frame of the flow after sending it */
+	void pop(Flow& flow)
+	{
+		flow.deficit -= flow.queue.front().data.size();
+		drop(flow);
+	}
+
+	/* Removes the head frame of the flow without charging it */
+	void drop(Flow& flow)
+	{
+		bytes -= flow.queue.front().data.size();
+		flow.queue.pop();
+		if (flow.queue.empty()) {
+			deactivate(flow);
+			for (auto it = active.begin(); it != active.end(); ++it) {
+				if (*it == &flow) {
+					active.erase(it);
+					break;
+				}
+			}
+		}
+	}
+
+	void clear()
+	{
+		for (auto flow : active) {
+			flow->queue.clear();
+			deactivate(*flow);
+		}
+		active.clear();
+		bytes = 0;
+	}
+
+	/* Queue depth of each active flow */
+	void print(std::ostream& os, const char *name) const
+	{
+		for (auto flow : active) {
+			os << "\t" << name << "_flow_" << (flow - flows.data()) << ": " <<
+				flow->queue.size() << " frames, " << flow->queue.size_bytes() << " bytes" << std::endl;
+		}
+	}
+};
@@ -0,0 +1,176 @@
+#pragma once
+
+/*
+ * Frame check sequence carried at the end of every frame: the legacy
+ * rotating checksum, CRC-32C, or nothing at all for transports which are
+ * already reliable.
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+extern "C" {
+#include "checksum.h"
+#include "crc32c.h"
+}
+
+class FrameCheck
+{
+public:
+	enum Mode
+	{
+		check_legacy,
+		check_crc32c,
+		check_none
+	};
+
+	/* Running check over a frame whose payload arrives in pieces */
+	class Sum
+	{
+		friend class FrameCheck;
+		std::uint8_t frame_type;
+		std::uint32_t value;
+		std::size_t offset;
+	};
+
+private:
+	Mode mode;
+
+public:
+	explicit FrameCheck(Mode mode) :
+		mode(mode)
+	{
+	}
+
+	Mode get_mode() const
+	{
+		return mode;
+	}
+
+	/* Size of trailer */
+	std::size_t size() const
+	{
+		return mode == check_none ? 0 : 4;
+	}
+
+	Sum start(std::uint8_t frame_type) const
+	{
+		Sum sum;
+		sum.frame_type = frame_type;
+		sum.offset = 0;
+		switch (mode) {
+		case check_legacy:
+			sum.value = CHECKSUM_INIT;
+			break;
+		case check_crc32c:
+			sum.value = crc32c(0, &frame_type, 1);
+			break;
+		default:
+			sum.value = 0;
+			break;
+		}
+		return sum;
+	}
+
+	void update(Sum& sum, const void *data, std::size_t size) const
+	{
+		switch (mode) {
+		case check_legacy:
+			sum.value = calc_checksum_update(sum.value, sum.offset, data, size);
+			break;
+		case check_crc32c:
+			sum.value = crc32c(sum.value, data, size);
+			break;
+		default:
+			break;
+		}
+		sum.offset += size;
+	}
+
+	std::uint32_t finish(const Sum& sum) const
+	{
+		return mode == check_legacy ? sum.value ^ sum.frame_type : sum.value;
+	}
+
+	/* Check value for frame of given type and payload */
+	std::uint32_t compute(std::uint8_t frame_type, const void *data, std::size_t size) const
+	{
+		auto sum = start(frame_type);
+		update(sum, data, size);
+		return finish(sum);
+	}
+
+	/* Writes trailer (big-endian) to out, returns its size */
+	std::size_t store(std::uint32_t value, std::uint8_t *out) const
+	{
+		if (mode == check_none) {
+			return 0;
+		}
+		out[0] = value >> 24;
+		out[1] = value >> 16;
+		out[2] = value >> 8;
+		out[3] = value;
+		return 4;
+	}
+
+	std::uint32_t load(const std::uint8_t *in) const
+	{
+		if (mode == check_none) {
+			return 0;
+		}
+		return std::uint32_t(in[0]) << 24 | std::uint32_t(in[1]) << 16 | std::uint32_t(in[2]) << 8 | in[3];
+	}
+};
+
+/*
+ * Runs the frame check over a frame ([type][payload][check]) while a decoder
+ * is still producing it, so no further pass is needed once it is complete.
+ * The trailing check bytes are held back since they are the check value
+ * itself.  Used as a decoder observer.
+ */
+class FrameVerifier
+{
+	/* Unchecked bytes to accumulate before running the check over them */
+	static constexpr std::size_t batch = 64;
+
+	const FrameCheck& check;
+	FrameCheck::Sum sum;
+	std::size_t checked{0};
+
+	void advance(const std::uint8_t *frame, std::size_t end)
+	{
+		if (checked == 0) {
+			sum = check.start(frame[0]);
+			checked = 1;
+		}
+		if (end > checked) {
+			check.update(sum, frame + checked, end - checked);
+			checked = end;
+		}
+	}
+
+public:
+	explicit FrameVerifier(const FrameCheck& check) :
+		check(check)
+	{
+	}
+
+	void start()
+	{
+		checked = 0;
+	}
+
+	void update(const std::uint8_t *frame, std::size_t size)
+	{
+		if (size >= checked + check.size() + batch) {
+			advance(frame, size - check.size());
+		}
+	}
+
+	/* Check value computed over complete frame (at least 1 + check.size() long) */
+	std::uint32_t finish(const std::uint8_t *frame, std::size_t size)
+	{
+		advance(frame, size - check.size());
+		return check.finish(sum);
+	}
+};
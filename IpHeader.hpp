@@ -0,0 +1,174 @@
+#pragma once
+
+/*
+ * Minimal IPv4/IPv6 header parsing, for classifying packets read from the
+ * TUN device.  Only looks at what the link needs: version, traffic class,
+ * transport protocol and where the transport header starts.
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+namespace IpHeader {
+
+static constexpr std::uint8_t proto_tcp = 6;
+static constexpr std::uint8_t proto_udp = 17;
+
+/* TCP flags */
+static constexpr std::uint8_t tcp_fin = 0x01;
+static constexpr std::uint8_t tcp_syn = 0x02;
+static constexpr std::uint8_t tcp_rst = 0x04;
+static constexpr std::uint8_t tcp_psh = 0x08;
+static constexpr std::uint8_t tcp_ack = 0x10;
+static constexpr std::uint8_t tcp_urg = 0x20;
+
+/* ECN code points */
+static constexpr std::uint8_t ecn_not_ect = 0;
+static constexpr std::uint8_t ecn_ce = 3;
+
+/* DiffServ code points */
+static constexpr std::uint8_t dscp_ef = 46;
+static constexpr std::uint8_t dscp_cs6 = 48;
+static constexpr std::uint8_t dscp_cs7 = 56;
+
+struct Info
+{
+	int version;
+	std::uint8_t dscp;
+	std::uint8_t ecn;
+	std::uint8_t protocol;
+	/* Whole IP packet, as given */
+	const std::uint8_t *ip;
+	std::size_t ip_size;
+	/* Transport header and payload */
+	const std::uint8_t *l4;
+	std::size_t l4_size;
+};
+
+inline std::uint16_t load16(const std::uint8_t *p)
+{
+	return std::uint16_t(p[0]) << 8 | p[1];
+}
+
+inline std::uint32_t load32(const std::uint8_t *p)
+{
+	return std::uint32_t(load16(p)) << 16 | load16(p + 2);
+}
+
+inline void store16(std::uint8_t *p, std::uint16_t value)
+{
+	p[0] = value >> 8;
+	p[1] = value;
+}
+
+inline void store32(std::uint8_t *p, std::uint32_t value)
+{
+	store16(p, value >> 16);
+	store16(p + 2, value);
+}
+
+/* Parses IP packet (without tun_frame_info), returns false if malformed */
+inline bool parse(const void *packet, std::size_t size, Info& info)
+{
+	const auto p = static_cast<const std::uint8_t *>(packet);
+	if (size < 1) {
+		return false;
+	}
+	info.version = p[0] >> 4;
+	info.ip = p;
+	info.ip_size = size;
+	if (info.version == 4) {
+		const std::size_t ihl = (p[0] & 0x0f) * 4;
+		if (size < 20 || ihl < 20 || size < ihl) {
+			return false;
+		}
+		info.dscp = p[1] >> 2;
+		info.ecn = p[1] & 3;
+		info.protocol = p[9];
+		info.l4 = p + ihl;
+		info.l4_size = size - ihl;
+		return true;
+	} else if (info.version == 6) {
+		if (size < 40) {
+			return false;
+		}
+		const std::uint8_t tc = (p[0] & 0x0f) << 4 | p[1] >> 4;
+		info.dscp = tc >> 2;
+		info.ecn = tc & 3;
+		/* Skip hop-by-hop, routing and destination options headers */
+		std::uint8_t next = p[6];
+		std::size_t offset = 40;
+		while ((next == 0 || next == 43 || next == 60) && offset + 8 <= size) {
+			next = p[offset];
+			offset += (p[offset + 1] + 1) * 8;
+		}
+		if (offset > size) {
+			return false;
+		}
+		info.protocol = next;
+		info.l4 = p + offset;
+		info.l4_size = size - offset;
+		return true;
+	}
+	return false;
+}
+
+/* IPv4 header checksum, over header with its checksum field included */
+inline std::uint16_t ipv4_checksum(const std::uint8_t *header, std::size_t size)
+{
+	std::uint32_t sum = 0;
+	for (std::size_t i = 0; i + 1 < size; i += 2) {
+		sum += load16(header + i);
+	}
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+	return ~sum;
+}
+
+/*
+ * Marks packet (parsed by parse) as Congestion Experienced, returns false if
+ * it is not ECN-capable.  The IPv4 header checksum is updated incrementally
+ * (RFC 1624).
+ */
+inline bool set_ce(std::uint8_t *packet, const Info& info)
+{
+	if (info.ecn == ecn_not_ect) {
+		return false;
+	}
+	if (info.version == 4) {
+		const std::uint16_t old_word = load16(packet);
+		packet[1] |= ecn_ce;
+		const std::uint16_t new_word = load16(packet);
+		std::uint32_t sum = std::uint16_t(~load16(packet + 10)) + std::uint16_t(~old_word) + new_word;
+		sum = (sum & 0xffff) + (sum >> 16);
+		sum = (sum & 0xffff) + (sum >> 16);
+		store16(packet + 10, ~sum);
+	} else {
+		packet[1] |= ecn_ce << 4;
+	}
+	return true;
+}
+
+/* Hash of addresses, protocol and ports, for sorting packets into flows */
+inline std::uint32_t flow_hash(const Info& info)
+{
+	/* FNV-1a */
+	std::uint32_t hash = 2166136261u;
+	const auto mix = [&hash] (const std::uint8_t *p, std::size_t size) {
+		for (std::size_t i = 0; i < size; i++) {
+			hash = (hash ^ p[i]) * 16777619u;
+		}
+	};
+	if (info.version == 4) {
+		mix(info.ip + 12, 8);
+	} else {
+		mix(info.ip + 8, 32);
+	}
+	mix(&info.protocol, 1);
+	if ((info.protocol == proto_tcp || info.protocol == proto_udp) && info.l4_size >= 4) {
+		mix(info.l4, 4);
+	}
+	return hash;
+}
+
+}
@@ -1,16 +1,22 @@
 extern "C" {
 #include "hexdump.h"
-#include "checksum.h"
 }
 
 #include <iostream>
 #include <iomanip>
+#include <fstream>
+#include <iterator>
+#include <chrono>
+#include <algorithm>
+#include <random>
 
 #include <arpa/inet.h>
+#include <linux/if_ether.h>
 
 #include "format_si.hpp"
 
 #include "IpLink.hpp"
+#include "IpHeader.hpp"
 
 namespace IpLink {
 
@@ -19,6 +25,242 @@ using namespace Linux;
 /* Frame types */
 static constexpr std::uint8_t ft_keepalive = 0x01;
 static constexpr std::uint8_t ft_ip_packet = 0x02;
+/* IP packet without tun_frame_info, only sent to peers advertising lo_bare_ip */
+static constexpr std::uint8_t ft_ip_bare = 0x03;
+/* Bare IPv4 TCP packet preceded by its header compression slot */
+static constexpr std::uint8_t ft_tcp_uncompressed = 0x04;
+/* Compressed TCP/IP header followed by payload */
+static constexpr std::uint8_t ft_tcp_compressed = 0x05;
+/* Bare UDP packet preceded by its header compression slot */
+static constexpr std::uint8_t ft_udp_full = 0x06;
+/* Compressed UDP/IP header followed by payload */
+static constexpr std::uint8_t ft_udp_compressed = 0x07;
+/* Original frame type followed by LZ-compressed frame */
+static constexpr std::uint8_t ft_lz = 0x08;
+/* Original frame type, sequence (and stored flag), frame compressed against earlier ones */
+static constexpr std::uint8_t ft_lz_stream = 0x09;
+/* Request to restart stream compression history */
+static constexpr std::uint8_t ft_lz_reset = 0x0a;
+/* Several frames, each as type, length (one byte, or two with the top bit set) and payload */
+static constexpr std::uint8_t ft_aggregate = 0x0b;
+/* Receiver's ARQ session, sequence, acknowledgement, then the numbered frame's type and payload */
+static constexpr std::uint8_t ft_arq = 0x0c;
+/* Receiver's ARQ session and acknowledgement, for when no numbered frame is going out */
+static constexpr std::uint8_t ft_arq_ack = 0x0d;
+/* Frame id, index (and last flag), then a piece of a frame which was too long to send whole */
+static constexpr std::uint8_t ft_fragment = 0x0e;
+
+/*
+ * Link options, sent in keep-alives after the ft_keepalive marker (peers which
+ * predate this send the marker alone, i.e. all options clear).  The high byte
+ * follows the dictionary id, then with ARQ enabled come our session, the
+ * peer's session as we know it (zero if not yet) and our acknowledgement.
+ */
+static constexpr std::uint8_t lo_cobs = 0x01;
+static constexpr std::uint8_t lo_crc32c = 0x02;
+static constexpr std::uint8_t lo_no_check = 0x04;
+/* Capabilities: advertised, but need not match the peer's */
+static constexpr std::uint8_t lo_bare_ip = 0x08;
+static constexpr std::uint8_t lo_tcp_hc = 0x10;
+static constexpr std::uint8_t lo_udp_hc = 0x20;
+static constexpr std::uint8_t lo_lz = 0x40;
+static constexpr std::uint8_t lo_lz_stream = 0x80;
+static constexpr std::uint16_t lo_aggregate = 0x0100;
+static constexpr std::uint16_t lo_arq = 0x0200;
+static constexpr std::uint16_t lo_fragment = 0x0400;
+static constexpr std::uint16_t lo_capabilities = lo_bare_ip | lo_tcp_hc | lo_udp_hc | lo_lz | lo_lz_stream | lo_aggregate | lo_arq | lo_fragment;
+
+/* Size of each UART read */
+static constexpr std::size_t uart_read_size = 1 << 16;
+
+/* Capacity of UART transmit queue */
+static constexpr std::size_t uart_tx_capacity = 1 << 20;
+
+/* Limits of each transmit class queue (bytes) */
+static constexpr std::size_t tx_control_limit = 1 << 12;
+static constexpr std::size_t tx_interactive_limit = 1 << 15;
+static constexpr std::size_t tx_bulk_limit = 1 << 16;
+
+/* Buffers for frames queued for transmission */
+static constexpr std::size_t tx_pool_size = 512;
+
+/* Number of hashed flow queues in each transmit class */
+static constexpr std::size_t tx_interactive_flows = 16;
+static constexpr std::size_t tx_bulk_flows = 64;
+
+/* Events handled per epoll_wait */
+static constexpr int epoll_batch = 16;
+
+/* Work done per wakeup before yielding to other descriptors */
+static constexpr int uart_rx_budget = 4;
+static constexpr int tun_rx_budget = 64;
+static constexpr int tun_tx_budget = 64;
+
+/* Least data kept queued in the serial driver */
+static constexpr std::size_t uart_queue_min = 64;
+
+/*
+ * Both framings open and close every frame with their delimiter, so frame
+ * boundaries on the line are doubled delimiters.  This many boundaries of the
+ * other framing over more than a frame without a good one, with ours no more
+ * often paired than alone, means the peer's framing differs.
+ */
+static constexpr std::size_t framing_mismatch_boundaries = 4;
+
+/* CoDel parameters for fast links, scaled up for slow ones in make_codel */
+static constexpr auto codel_target = std::chrono::milliseconds(5);
+static constexpr auto codel_interval = std::chrono::milliseconds(100);
+
+/* TCP connections and UDP flows tracked by header compression */
+static constexpr std::size_t tcp_hc_slots = 16;
+static constexpr std::size_t udp_hc_slots = Iphc::max_slots;
+
+/* Frames smaller than this are not worth compressing */
+static constexpr std::size_t lz_min_size = 64;
+/* Entropy is only estimated for frames this large, smaller samples read low */
+static constexpr std::size_t lz_entropy_min_size = 256;
+/* Frames above this many bits per byte are sent as they are (already compressed or encrypted) */
+static constexpr double lz_max_entropy = 7.0;
+
+/* Stream compression history */
+static constexpr std::size_t lz_stream_window = 1 << 15;
+/* Stream frame header: original type, then sequence with stored flag */
+static constexpr std::size_t lz_stream_header = 2;
+static constexpr std::uint8_t lz_stream_stored = 0x80;
+static constexpr std::uint8_t lz_stream_seq_mask = 0x7f;
+/* Repeat a reset request after this many stream frames are dropped, in case it was lost */
+static constexpr unsigned lz_reset_retry = 16;
+
+/* Largest frame carried in an aggregate, limited by its two-byte length */
+static constexpr std::size_t aggregate_max_item = 0x7fff;
+
+/* Fragment header: frame id, then index with last flag */
+static constexpr std::size_t fragment_header_size = 2;
+static constexpr std::uint8_t fragment_last = 0x80;
+static constexpr std::uint8_t fragment_index_mask = 0x7f;
+/* Least fragment, however fast the link */
+static constexpr std::size_t fragment_min_payload = 64;
+/* Partly reassembled frame is dropped after this long without a fragment, longer than ARQ can take to resend one */
+static constexpr auto reassembly_timeout = std::chrono::seconds(5);
+
+/* Numbered frame header: session and sequence, then acknowledgement */
+static constexpr std::size_t arq_header_size = 2 + Arq::max_ack;
+/* Keep-alive with its ARQ fields */
+static constexpr std::size_t keepalive_size = 5 + 2 + Arq::max_ack;
+/* Acknowledgement is held this long for a frame to carry it, or for a second frame to acknowledge together */
+static constexpr std::uint64_t arq_ack_delay_us = 5000;
+/* Least retransmission timeout */
+static constexpr auto arq_min_rto = std::chrono::milliseconds(20);
+
+/* IP packets up to this size are considered interactive */
+static constexpr std::size_t interactive_size = 128;
+
+/*
+ * Largest decoded frame: type byte, ARQ header and numbered frame's type,
+ * stream compression header, fragment header and fragmented frame's type,
+ * TUN frame, checksum
+ */
+static std::size_t max_frame_size(const Config& config)
+{
+	return 1 + (config.arq ? arq_header_size + 1 : 0) + lz_stream_header +
+		(config.fragment_ms > 0 ? fragment_header_size + 1 : 0) + sizeof(struct tun_frame_info) + config.mtu + 4;
+}
+
+/* Largest frame before KISS/COBS encoding, with any FEC parity */
+static std::size_t max_coded_frame_size(const Config& config)
+{
+	const auto size = max_frame_size(config);
+	return config.fec_parity > 0 ? ReedSolomon::encoded_size(size, config.fec_parity) : size;
+}
+
+/* Time to send a full-size frame (ten bit times per byte) */
+static std::chrono::duration<double> frame_time(const Config& config)
+{
+	const auto bit_rate = config.tx_rate > 0 ? std::min(config.tx_rate, config.baud) : config.baud;
+	return std::chrono::duration<double>(10.0 * max_coded_frame_size(config) / bit_rate);
+}
+
+/* Largest piece of a frame in a fragment, zero if frames are never split */
+static std::size_t fragment_payload(const Config& config)
+{
+	if (config.fragment_ms == 0) {
+		return 0;
+	}
+	const auto bit_rate = config.tx_rate > 0 ? std::min(config.tx_rate, config.baud) : config.baud;
+	/* The index limits how many pieces a frame can be split into */
+	const auto least = (max_frame_size(config) + fragment_index_mask) / (fragment_index_mask + 1);
+	return std::max({ fragment_min_payload, least, std::size_t(bit_rate) / 10 * config.fragment_ms / 1000 });
+}
+
+/* Longest wait for the next fragment, in milliseconds: slow links take a while to send what goes between */
+static unsigned reassembly_timeout_ms(const Config& config)
+{
+	const auto timeout = std::max<std::chrono::duration<double>>(reassembly_timeout, 4 * frame_time(config));
+	return std::chrono::duration_cast<std::chrono::milliseconds>(timeout).count();
+}
+
+/*
+ * Round trip time can't be less than our frame waiting for the UART queue,
+ * the peer's frame ahead of its acknowledgement and the acknowledgement delay
+ */
+static Arq::Clock::duration arq_rto_floor(const Config& config)
+{
+	const auto round_trip = 2 * (frame_time(config) + std::chrono::milliseconds(config.uart_queue_ms)) +
+		std::chrono::microseconds(arq_ack_delay_us);
+	return std::max<Arq::Clock::duration>(arq_min_rto, std::chrono::duration_cast<Arq::Clock::duration>(round_trip));
+}
+
+/*
+ * Frames which are periodic or carry link state: sent alone and uncompressed,
+ * so a peer whose stream history is out of step still reads them, and never
+ * numbered by ARQ
+ */
+static bool is_control(std::uint8_t frame_type)
+{
+	return frame_type == ft_keepalive || frame_type == ft_lz_reset || frame_type == ft_arq || frame_type == ft_arq_ack;
+}
+
+/* Random nonzero ARQ session */
+static std::uint8_t make_arq_session()
+{
+	std::random_device rd;
+	return rd() % 255 + 1;
+}
+
+/* Size of frame info on packets read from or written to our TUN device */
+static std::size_t tun_header_size(const Config& config)
+{
+	return config.tun_no_pi ? 0 : sizeof(struct tun_frame_info);
+}
+
+/* Space taken by a frame in an aggregate */
+static std::size_t aggregate_item_size(std::size_t size)
+{
+	return 1 + (size < 0x80 ? 1 : 2) + size;
+}
+
+/* Frame info for a bare IP packet, protocol derived from its version */
+static struct tun_frame_info make_frame_info(const void *packet, std::size_t size)
+{
+	struct tun_frame_info info = {};
+	const int version = size > 0 ? static_cast<const std::uint8_t *>(packet)[0] >> 4 : 0;
+	info.proto = htons(version == 6 ? ETH_P_IPV6 : ETH_P_IP);
+	return info;
+}
+
+/* Identifies a stream compression dictionary, so peers can tell if theirs match */
+static std::uint16_t dictionary_id(const std::vector<std::uint8_t>& dictionary)
+{
+	if (dictionary.empty()) {
+		return 0;
+	}
+	/* FNV-1a, folded, never zero */
+	std::uint32_t hash = 2166136261u;
+	for (const auto byte : dictionary) {
+		hash = (hash ^ byte) * 16777619u;
+	}
+	return std::uint16_t(hash ^ hash >> 16) | 1;
+}
 
 void IpLink::verbose_hexdump(const char *title, const void *buf, size_t len)
 {
@@ -69,8 +311,31 @@ void IpLink::peer_state_changed(bool value)
 	} else {
 		std::cout << "[peer disconnected]" << std::endl;
 		is_connected = false;
+		peer_link_options.reset();
+		peer_lz_dictionary_id = 0;
+		reset_tx_stream();
+		lz_stream_decompressor.reset();
+		lz_rx_seq.reset();
+		tx_aggregate_size = 0;
+		tx_aggregate_count = 0;
+		tx_fragment_size = 0;
+		rx_fragment_id.reset();
+		if (tx_lingering) {
+			tx_linger.disarm();
+			tx_lingering = false;
+		}
+		tcp_compressor.reset();
+		tcp_decompressor.reset();
+		udp_compressor.reset();
+		udp_decompressor.reset();
+		if (arq_sender) {
+			arq_reset();
+		}
 		uart_rx_buf.clear();
 		uart_tx_buf.clear();
+		for (auto& queue : tx_queues) {
+			queue.clear();
+		}
 	}
 	is_connected = value;
 	if (config.updown) {
@@ -79,6 +344,11 @@ void IpLink::peer_state_changed(bool value)
 }
 
 void IpLink::update_timer(Linux::TimerFD& timer, unsigned delay)
+{
+	update_timer_us(timer, std::uint64_t(delay) * 1000);
+}
+
+void IpLink::update_timer_us(Linux::TimerFD& timer, std::uint64_t delay)
 {
 	if (delay == 0) {
 		return;
@@ -90,8 +360,8 @@ void IpLink::update_timer(Linux::TimerFD& timer, unsigned delay)
 
 	Linux::TimerFD::TimeSpec deadline;
 	clock_gettime(Linux::Clock::monotonic, &deadline);
-	deadline.tv_sec += delay / thousand;
-	deadline.tv_nsec += delay % thousand * million;
+	deadline.tv_sec += delay / million;
+	deadline.tv_nsec += delay % million * thousand;
 	if (deadline.tv_nsec >= billion) {
 		deadline.tv_nsec -= billion;
 		deadline.tv_sec++;
@@ -114,15 +384,21 @@ void IpLink::reset_recv_ka_timer()
 
 void IpLink::rebind_serial_events()
 {
+	if (config.edge_triggered) {
+		return;
+	}
 	epfd.rebind(uart,
-		(uart_rx_buf.empty() ? Events::event_in : Events::event_none) |
-		(!uart_tx_buf.empty() ? Events::event_out : Events::event_none));
+		(uart_rx_buf.size_bytes() <= uart_rx_high_water ? Events::event_in : Events::event_none) |
+		(!uart_tx_buf.empty() && !tx_paced ? Events::event_out : Events::event_none));
 }
 
 void IpLink::rebind_tun_events()
 {
+	if (config.edge_triggered) {
+		return;
+	}
 	epfd.rebind(tun,
-		(tun_up && uart_tx_buf.empty() ? Events::event_in : Events::event_none) |
+		(tun_up ? Events::event_in : Events::event_none) |
 		(tun_up && !uart_rx_buf.empty() ? Events::event_out : Events::event_none));
 }
 
@@ -134,7 +410,24 @@ void IpLink::rebind_events()
 
 void IpLink::send_keepalive()
 {
-	write_packet(ft_keepalive, &ft_keepalive, 1);
+	std::uint8_t payload[keepalive_size] = {
+		ft_keepalive, std::uint8_t(link_options),
+		std::uint8_t(lz_dictionary_id >> 8), std::uint8_t(lz_dictionary_id),
+		std::uint8_t(link_options >> 8) };
+	std::size_t size = 5;
+	if (arq_receiver) {
+		/* Repeats our acknowledgement in case the last was lost, still owed to the next frame */
+		payload[size++] = arq_session;
+		payload[size++] = peer_arq_session.value_or(0);
+		size += arq_receiver->ack().store(&payload[size]);
+	}
+	auto buffer = packet_pool.alloc(payload, size);
+	if (buffer) {
+		queue_packet(tx_control, 0, ft_keepalive, std::move(buffer));
+		pump_tx();
+	} else {
+		stats.inc_tx_pool_drops(1);
+	}
 
 	rebind_serial_events();
 	on_sent_keepalive();
@@ -160,6 +453,82 @@ void IpLink::on_missed_keepalive()
 	}
 }
 
+void IpLink::check_link_options(const void *data, size_t size)
+{
+	const auto p = static_cast<const std::uint8_t *>(data);
+	const std::uint16_t options = (size >= 2 ? p[1] : 0) | (size >= 5 ? p[4] << 8 : 0);
+	const std::uint16_t peer_dictionary = size >= 4 ? IpHeader::load16(p + 2) : 0;
+	if (options == peer_link_options && peer_dictionary == peer_lz_dictionary_id) {
+		return;
+	}
+	peer_link_options = options;
+	peer_lz_dictionary_id = peer_dictionary;
+	/* Peer may have restarted, its decompressors know none of our state */
+	tcp_compressor.reset();
+	udp_compressor.reset();
+	reset_tx_stream();
+	if ((options & ~lo_capabilities) != (link_options & ~lo_capabilities)) {
+		stats.inc_link_option_mismatches(1);
+		std::cerr << "[peer link options mismatch: local " << std::hex << int(link_options) << ", peer " << int(options) << std::dec << "]" << std::endl;
+	}
+}
+
+void IpLink::check_framing(const std::uint8_t *data, size_t size)
+{
+	const bool cobs = std::holds_alternative<Cobs::Decoder>(decoder);
+	const std::uint8_t own = cobs ? Cobs::Config::DELIM : Kiss::Config::FEND;
+	const std::uint8_t other = cobs ? Kiss::Config::FEND : Cobs::Config::DELIM;
+	auto& seen = rx_boundaries;
+	/* Counts are cleared by every good frame, only reads without one are looked at */
+	if (seen.good_frame || seen.reported) {
+		seen.good_frame = false;
+		rx_last_byte = data[size - 1];
+		return;
+	}
+	std::uint8_t prev = rx_last_byte;
+	for (size_t i = 0; i < size; i++) {
+		const std::uint8_t byte = data[i];
+		if (byte == own) {
+			seen.own_run++;
+		} else {
+			seen.own_lone += seen.own_run == 1;
+			seen.own += seen.own_run > 1;
+			seen.own_run = 0;
+			seen.other += byte == other && prev == other;
+		}
+		prev = byte;
+	}
+	rx_last_byte = prev;
+	seen.bytes += size;
+	/* Until more than one frame's worth has gone by, the pairs may just be data in a frame still arriving */
+	const auto max_line_frame = std::visit([&] (auto& encoder) {
+		return encoder.max_frame_length(max_coded_frame_size(config));
+	}, encoder);
+	/* Our own delimiter only ever comes in pairs, unless the data is in the other framing */
+	if (seen.other >= framing_mismatch_boundaries && seen.own <= seen.own_lone && seen.bytes > max_line_frame) {
+		seen.reported = true;
+		stats.inc_framing_mismatches(1);
+		std::cerr << "[peer framing mismatch: local " << (cobs ? "cobs" : "kiss") << ", peer appears to use " << (cobs ? "kiss" : "cobs") << "]" << std::endl;
+	}
+}
+
+void IpLink::on_event(std::uint64_t slot, Events events)
+{
+	switch (slot) {
+	case slot_signal: on_signal(events); break;
+	case slot_meter: on_update_meter(events); break;
+	case slot_send_ka: on_send_ka_timer(events); break;
+	case slot_recv_ka: on_recv_ka_timer(events); break;
+	case slot_tx_pace: on_tx_pace_timer(events); break;
+	case slot_tx_linger: on_tx_linger_timer(events); break;
+	case slot_rx_reassembly: on_rx_reassembly_timer(events); break;
+	case slot_arq_rto: on_arq_rto_timer(events); break;
+	case slot_arq_ack: on_arq_ack_timer(events); break;
+	case slot_serial: on_serial(events); break;
+	case slot_tun: on_tun(events); break;
+	}
+}
+
 void IpLink::on_signal(Events events)
 {
 	if (events & Events::event_in) {
@@ -172,6 +541,8 @@ void IpLink::on_signal(Events events)
 			break;
 		case SIGUSR1:
 			stats.print(std::cout);
+			tx_queues[tx_interactive].print(std::cout, "tx_interactive");
+			tx_queues[tx_bulk].print(std::cout, "tx_bulk");
 			break;
 		}
 	}
@@ -187,16 +558,64 @@ void IpLink::on_update_meter(Events events)
 
 void IpLink::on_send_ka_timer(Events events)
 {
-	if (events & Events::event_in) {
-		send_ka.read_tick_count();
+	/* Timer may have been re-armed by an earlier event in the same batch */
+	if ((events & Events::event_in) && send_ka.try_read_tick_count()) {
 		send_keepalive();
 	}
 }
 
+void IpLink::on_tx_pace_timer(Events events)
+{
+	if ((events & Events::event_in) && tx_pace.try_read_tick_count()) {
+		tx_paced = false;
+		rebind_serial_events();
+	}
+}
+
+void IpLink::on_tx_linger_timer(Events events)
+{
+	if ((events & Events::event_in) && tx_linger.try_read_tick_count()) {
+		tx_lingering = false;
+		flush_aggregate();
+		rebind_serial_events();
+	}
+}
+
+void IpLink::on_rx_reassembly_timer(Events events)
+{
+	if ((events & Events::event_in) && rx_reassembly.try_read_tick_count() && rx_fragment_id) {
+		rx_fragment_id.reset();
+		stats.inc_rx_reassembly_timeouts(1);
+	}
+}
+
+void IpLink::on_arq_rto_timer(Events events)
+{
+	if ((events & Events::event_in) && arq_rto.try_read_tick_count() && arq_active()) {
+		arq_sender->for_each_expired(Arq::Clock::now(), [this] (std::uint8_t seq) {
+			stats.inc_arq_timeouts(1);
+			stats.inc_arq_retransmits(1);
+			arq_transmit(seq);
+		});
+		arq_update_timer();
+		rebind_serial_events();
+	}
+}
+
+void IpLink::on_arq_ack_timer(Events events)
+{
+	if ((events & Events::event_in) && arq_ack.try_read_tick_count()) {
+		arq_ack_armed = false;
+		if (arq_unacked > 0 && arq_active()) {
+			arq_send_ack();
+		}
+		rebind_serial_events();
+	}
+}
+
 void IpLink::on_recv_ka_timer(Events events)
 {
-	if (events & Events::event_in) {
-		recv_ka.read_tick_count();
+	if ((events & Events::event_in) && recv_ka.try_read_tick_count()) {
 		on_missed_keepalive();
 		reset_recv_ka_timer();
 	}
@@ -204,6 +623,12 @@ void IpLink::on_recv_ka_timer(Events events)
 
 void IpLink::on_serial(Events events)
 {
+	if (config.edge_triggered) {
+		/* Work is done by service_ready, until the descriptor runs dry */
+		serial_readable |= bool(events & Events::event_in);
+		serial_writable |= bool(events & Events::event_out);
+		return;
+	}
 	if (events & Events::event_in) {
 		on_serial_readable();
 	}
@@ -215,6 +640,11 @@ void IpLink::on_serial(Events events)
 
 void IpLink::on_tun(Events events)
 {
+	if (config.edge_triggered) {
+		tun_readable |= bool(events & Events::event_in);
+		tun_writable |= bool(events & Events::event_out);
+		return;
+	}
 	if (events & Events::event_in) {
 		on_tun_readable();
 	}
@@ -224,119 +654,1109 @@ void IpLink::on_tun(Events events)
 	rebind_events();
 }
 
-void IpLink::on_serial_readable()
+bool IpLink::serial_read_allowed() const
 {
-	buffer.resize(1 << 16);
-	uart.read(buffer);
-	stats.inc_uart_rx_bytes(buffer.size());
-	uart_rx_buf.splice(uart_rx_buf.end(), decoder.decode(buffer));
-	on_received_keepalive();
+	return uart_rx_buf.size_bytes() <= uart_rx_high_water;
+}
+
+bool IpLink::serial_write_allowed() const
+{
+	return !uart_tx_buf.empty() && !tx_paced;
+}
+
+bool IpLink::has_ready_work() const
+{
+	return (serial_readable && serial_read_allowed()) ||
+		(serial_writable && serial_write_allowed()) ||
+		tun_readable ||
+		(tun_writable && !uart_rx_buf.empty());
+}
+
+void IpLink::service_ready()
+{
+	if (serial_readable && serial_read_allowed()) {
+		serial_readable = !on_serial_readable();
+	}
+	if (tun_writable && !uart_rx_buf.empty()) {
+		on_tun_writable();
+	}
+	if (tun_readable) {
+		tun_readable = !on_tun_readable();
+	}
+	if (serial_writable && serial_write_allowed()) {
+		serial_writable = !on_serial_writable();
+	}
+}
+
+bool IpLink::on_serial_readable()
+{
+	/* Bad frames are dropped here, without being queued; checksum is not queued either */
+	const auto sink = [this] (const std::uint8_t *data, std::size_t size) {
+		if (fec) {
+			/* Decoder's buffer is read-only, correct a copy */
+			std::memcpy(fec_rx_buf.data(), data, size);
+			fec_correct_frame(fec_rx_buf.data(), size);
+			data = fec_rx_buf.data();
+		}
+		if (!verify_frame(data, size)) {
+			/* Lost frame may have carried header compression deltas, unless it will be retransmitted */
+			if (!arq_active()) {
+				tcp_decompressor.toss();
+			}
+			return;
+		}
+		rx_boundaries = {};
+		rx_boundaries.good_frame = true;
+		if (arq_sender && arq_handle_frame(data, size - frame_check.size())) {
+			/* Held for delivery in order, or an acknowledgement */
+		} else if (!uart_rx_buf.push(data, size - frame_check.size())) {
+			stats.inc_uart_rx_overflows(1);
+			tcp_decompressor.toss();
+		}
+	};
+	/* Read until drained, out of budget or the receive queue is filling up */
+	bool drained = false;
+	for (int i = 0; i < uart_rx_budget && serial_read_allowed(); i++) {
+		const auto size = uart.try_read(uart_read_buf.data(), uart_read_buf.size()).value_or(0);
+		if (size == 0) {
+			drained = true;
+			break;
+		}
+		stats.inc_uart_rx_reads(1);
+		stats.inc_uart_rx_bytes(size);
+		const std::uint8_t *begin = uart_read_buf.data();
+		std::visit([&] (auto& decoder) {
+			/* With FEC, the frame is only checked once corrected */
+			if (fec) {
+				decoder.decode(begin, begin + size, sink);
+			} else {
+				decoder.decode(begin, begin + size, sink, frame_verifier);
+			}
+		}, decoder);
+		check_framing(begin, size);
+		on_received_keepalive();
+		if (size < uart_read_buf.size()) {
+			drained = true;
+			break;
+		}
+	}
+	/* Acknowledgements may have opened the window, or be owed */
+	if (arq_sender) {
+		pump_tx();
+	}
+	return drained;
 }
 
-void IpLink::on_serial_writable()
+bool IpLink::on_serial_writable()
 {
+	const auto now = TokenBucket::Clock::now();
 	/*
-	 * Take data from queue and send it, remove sent data
-	 * from queue
+	 * Only top up the driver's queue to a few milliseconds of line time, so
+	 * frames wait here where they can still be reordered or dropped
 	 */
-	const auto block_size = std::min<std::size_t>(1 << 16, uart_tx_buf.size());
-	buffer.resize(block_size);
-	const auto block_begin = uart_tx_buf.begin();
-	const auto block_end = block_begin + block_size;
-	std::copy(block_begin, block_end, buffer.begin());
-	const auto sent_length = uart.write(buffer.data(), buffer.size());
+	const auto queued = uart.output_queue_size();
+	auto budget = queued < uart_queue_limit ? uart_queue_limit - queued : 0;
+	if (tx_bucket) {
+		budget = std::min(budget, tx_bucket->available(now));
+	}
+	/* Send straight from the queue, remove sent data from queue */
+	const auto length = std::min(budget, uart_tx_buf.size());
+	const auto sent_length = length > 0 ? uart.try_write(uart_tx_buf.read_data(), length).value_or(0) : 0;
 	stats.inc_uart_tx_bytes(sent_length);
-	const auto sent_end = block_begin + sent_length;
-	uart_tx_buf.erase(block_begin, sent_end);
+	uart_tx_buf.consume(sent_length);
+	if (tx_bucket) {
+		tx_bucket->consume(sent_length);
+	}
+	pump_tx();
+	/* Sleep while the driver drains instead of spinning on writability */
+	if (!uart_tx_buf.empty()) {
+		auto delay = std::max<unsigned>(1, config.uart_queue_ms / 2);
+		if (tx_bucket) {
+			delay = std::max<unsigned>(delay, tx_bucket->time_until(uart_tx_buf.size(), now).count());
+		}
+		tx_paced = true;
+		update_timer(tx_pace, delay);
+	}
 	/* Reset keepalive timer since we've just sent data */
 	if (sent_length > 0) {
 		on_sent_keepalive();
 	}
+	/* Driver's buffer is full */
+	return sent_length < length;
+}
+
+bool IpLink::on_tun_readable()
+{
+	bool drained = false;
+	for (int i = 0; i < tun_rx_budget; i++) {
+		/* Read straight into a pool buffer, which is then queued as-is */
+		auto buffer = packet_pool.alloc();
+		Frame frame(buffer ? buffer.data() : tun_rx_frame.buffer, 0);
+		if (!tun.try_recv(frame)) {
+			drained = true;
+			break;
+		}
+		stats.inc_tun_rx_reads(1);
+		if (!buffer) {
+			stats.inc_tx_pool_drops(1);
+		} else if (tun_up) {
+			stats.inc_tun_rx_frames(1);
+			stats.inc_tun_rx_bytes(frame.size - tun_header_size(config));
+			verbose_hexdump("TUN ==> UART", frame.buffer, frame.size);
+
+			buffer.resize(frame.size);
+			std::uint32_t flow;
+			const auto tx_class = classify(buffer.data(), buffer.size(), flow);
+			queue_packet(tx_class, flow, ft_ip_packet, std::move(buffer));
+		} else {
+			stats.inc_tun_rx_ignored_frames(1);
+			stats.inc_tun_rx_ignored_bytes(frame.size - tun_header_size(config));
+		}
+	}
+	/* Encode once the whole batch is queued, so its packets can share an aggregate */
+	pump_tx();
+	return drained;
+}
+
+IpLink::TxClass IpLink::classify(const void *frame, size_t size, std::uint32_t& flow) const
+{
+	using namespace IpHeader;
+	const auto tfi_size = tun_header_size(config);
+	Info ip;
+	if (size < tfi_size || !parse(static_cast<const std::uint8_t *>(frame) + tfi_size, size - tfi_size, ip)) {
+		flow = 0;
+		return tx_bulk;
+	}
+	flow = flow_hash(ip);
+	if (ip.dscp == dscp_ef || ip.dscp == dscp_cs6 || ip.dscp == dscp_cs7) {
+		return tx_interactive;
+	}
+	if (ip.ip_size <= interactive_size) {
+		return tx_interactive;
+	}
+	if (ip.protocol == proto_tcp && ip.l4_size >= 20) {
+		const std::uint8_t flags = ip.l4[13];
+		const std::size_t data_offset = (ip.l4[12] >> 4) * 4;
+		/* Connection setup/teardown and pure ACKs */
+		if ((flags & (tcp_syn | tcp_fin | tcp_rst)) || ip.l4_size <= data_offset) {
+			return tx_interactive;
+		}
+	}
+	return tx_bulk;
 }
 
-void IpLink::on_tun_readable()
+void IpLink::queue_packet(TxClass tx_class, std::uint32_t flow, std::uint8_t frame_type, PacketPool::Buffer&& data)
 {
-	const auto frame = tun.recv();
-	if (tun_up) {
-		stats.inc_tun_rx_frames(1);
-		stats.inc_tun_rx_bytes(frame.size - sizeof(struct tun_frame_info));
+	const auto dropped = tx_queues[tx_class].push(flow, frame_type, std::move(data));
+	switch (tx_class) {
+	case tx_control:
+		stats.inc_tx_control_frames(1);
+		stats.inc_tx_control_drops(dropped);
+		break;
+	case tx_interactive:
+		stats.inc_tx_interactive_frames(1);
+		stats.inc_tx_interactive_drops(dropped);
+		break;
+	default:
+		stats.inc_tx_bulk_frames(1);
+		stats.inc_tx_bulk_drops(dropped);
+		break;
+	}
+}
 
-		write_packet(ft_ip_packet, frame.buffer, frame.size);
+bool IpLink::mark_congestion(TxQueue::Packet& packet)
+{
+	const auto tfi_size = tun_header_size(config);
+	IpHeader::Info ip;
+	if (packet.frame_type != ft_ip_packet || packet.data.size() < tfi_size ||
+			!IpHeader::parse(packet.data.data() + tfi_size, packet.data.size() - tfi_size, ip)) {
+		return false;
+	}
+	return IpHeader::set_ce(packet.data.data() + tfi_size, ip);
+}
 
-		verbose_hexdump("TUN ==> UART", frame.buffer, frame.size);
+void IpLink::pump_tx()
+{
+	const auto now = TxQueue::Clock::now();
+	for (int tx_class = 0; tx_class < tx_class_count; tx_class++) {
+		auto& fq = tx_queues[tx_class];
+		FairQueue::Flow *flow;
+		/*
+		 * Encoded frames can no longer be prioritised, so only encode what the
+		 * pacer will send next; the aggregate counts as one frame, like a
+		 * full-size packet
+		 */
+		while (uart_tx_buf.size() < uart_queue_limit && !arq_window_closed(tx_class)) {
+			/* A bulk packet's fragments go before the next packet, but only once higher classes are served */
+			if (tx_class == tx_bulk && tx_fragment_size > 0) {
+				flush_aggregate();
+				write_fragment();
+				continue;
+			}
+			if (!(flow = fq.next())) {
+				break;
+			}
+			auto& packet = flow->queue.front();
+			if (tx_class != tx_control && flow->codel.dequeue(flow->queue, now) == Codel::drop) {
+				if (mark_congestion(packet)) {
+					stats.inc_tx_ecn_marks(1);
+				} else {
+					stats.inc_tx_aqm_drops(1);
+					fq.drop(*flow);
+					continue;
+				}
+			}
+			stats.inc_tx_dequeued_frames(1);
+			stats.inc_tx_sojourn_ms(std::chrono::duration_cast<std::chrono::milliseconds>(now - packet.enqueued).count());
+			/* Header compression state must reach the peer in order, which fragments would not keep */
+			const bool fragment = tx_class == tx_bulk && fragmenting() && 1 + packet.data.size() > tx_fragment_payload;
+			adapt_ip_frame(packet, !fragment);
+			if (fragment) {
+				flush_aggregate();
+				fragment_packet(packet.frame_type, packet.data.data(), packet.data.size());
+			} else {
+				aggregate_packet(packet.frame_type, packet.data.data(), packet.data.size());
+			}
+			fq.pop(*flow);
+		}
+		const bool waiting = !fq.empty() || (tx_class == tx_bulk && tx_fragment_size > 0);
+		if (arq_window_closed(tx_class) && waiting && !arq_stalled) {
+			arq_stalled = true;
+			stats.inc_arq_window_stalls(1);
+		}
+	}
+	/* Hold a partial aggregate briefly for more packets, aggregate_packet sends it once full */
+	if (tx_aggregate_count > 0) {
+		if (config.aggregate_linger_us == 0) {
+			flush_aggregate();
+		} else if (!tx_lingering) {
+			tx_lingering = true;
+			update_timer_us(tx_linger, config.aggregate_linger_us);
+		}
+	}
+	/* No numbered frame went out to carry the acknowledgement */
+	if (arq_ack_now && arq_active()) {
+		arq_send_ack();
+	}
+}
+
+void IpLink::aggregate_packet(std::uint8_t frame_type, const void *data, size_t size)
+{
+	const auto options = peer_link_options.value_or(0) & link_options;
+	const auto item_size = aggregate_item_size(size);
+	/* When fragmenting, an aggregate is kept to a fragment's length so it never needs splitting */
+	const auto capacity = fragmenting() ? std::min(tx_aggregate_buf.size(), tx_fragment_payload) : tx_aggregate_buf.size();
+	/* Control frames go alone: with ARQ, keep-alives are then also read as they are decoded */
+	if (!(options & lo_aggregate) || size > aggregate_max_item || item_size > capacity || is_control(frame_type)) {
+		flush_aggregate();
+		write_packet(frame_type, data, size);
+		return;
+	}
+	if (tx_aggregate_size + item_size > capacity) {
+		flush_aggregate();
+	}
+	auto p = &tx_aggregate_buf[tx_aggregate_size];
+	*p++ = frame_type;
+	if (size < 0x80) {
+		*p++ = size;
+	} else {
+		*p++ = 0x80 | size >> 8;
+		*p++ = size;
+	}
+	std::memcpy(p, data, size);
+	tx_aggregate_size += item_size;
+	tx_aggregate_count++;
+}
+
+void IpLink::flush_aggregate()
+{
+	if (tx_aggregate_count == 0) {
+		return;
+	}
+	if (tx_lingering) {
+		tx_linger.disarm();
+		tx_lingering = false;
+	}
+	const auto p = tx_aggregate_buf.data();
+	if (tx_aggregate_count == 1) {
+		/* Nothing to share the frame with, send as it would have been */
+		const std::size_t header_size = p[1] < 0x80 ? 2 : 3;
+		write_packet(p[0], p + header_size, tx_aggregate_size - header_size);
 	} else {
-		stats.inc_tun_rx_ignored_frames(1);
-		stats.inc_tun_rx_ignored_bytes(frame.size - sizeof(struct tun_frame_info));
+		stats.inc_tx_aggregates(1);
+		stats.inc_tx_aggregated_frames(tx_aggregate_count);
+		write_packet(ft_aggregate, p, tx_aggregate_size);
 	}
+	tx_aggregate_size = 0;
+	tx_aggregate_count = 0;
+}
+
+bool IpLink::fragmenting() const
+{
+	return tx_fragment_payload > 0 && (peer_link_options.value_or(0) & lo_fragment);
+}
+
+void IpLink::fragment_packet(std::uint8_t frame_type, const void *data, size_t size)
+{
+	auto p = &tx_fragment_buf[fragment_header_size];
+	p[0] = frame_type;
+	std::memcpy(p + 1, data, size);
+	tx_fragment_size = 1 + size;
+	tx_fragment_offset = 0;
+	tx_fragment_index = 0;
+	tx_fragment_id++;
+	stats.inc_tx_fragmented_frames(1);
+}
+
+void IpLink::write_fragment()
+{
+	const auto chunk = std::min(tx_fragment_payload, tx_fragment_size - tx_fragment_offset);
+	const bool last = tx_fragment_offset + chunk == tx_fragment_size;
+	/* Header goes just before the piece, over the end of the piece already sent */
+	const auto p = &tx_fragment_buf[tx_fragment_offset];
+	p[0] = tx_fragment_id;
+	p[1] = tx_fragment_index++ | (last ? fragment_last : 0);
+	stats.inc_tx_fragments(1);
+	write_packet(ft_fragment, p, fragment_header_size + chunk);
+	tx_fragment_offset += chunk;
+	if (last) {
+		tx_fragment_size = 0;
+	}
+}
+
+void IpLink::adapt_ip_frame(TxQueue::Packet& packet, bool compress)
+{
+	const auto tfi_size = sizeof(struct tun_frame_info);
+	if (packet.frame_type != ft_ip_packet) {
+		return;
+	}
+	if (peer_link_options.value_or(0) & lo_bare_ip) {
+		if (!config.tun_no_pi && packet.data.size() >= tfi_size) {
+			packet.data.pop_front(tfi_size);
+		}
+		packet.frame_type = ft_ip_bare;
+		if (compress) {
+			compress_header(packet);
+		}
+	} else if (config.tun_no_pi) {
+		/* Peer predates bare frames */
+		const auto info = make_frame_info(packet.data.data(), packet.data.size());
+		std::memcpy(packet.data.push_front(tfi_size), &info, tfi_size);
+	}
+}
+
+void IpLink::compress_header(TxQueue::Packet& packet)
+{
+	const auto options = peer_link_options.value_or(0) & link_options;
+	const auto data = packet.data.data();
+	const auto size = packet.data.size();
+	std::uint8_t header[std::max(Vj::max_compressed, Iphc::max_compressed)];
+	std::size_t header_size;
+	std::size_t original_size;
+	std::uint8_t slot;
+	IpHeader::Info info;
+	if (!IpHeader::parse(data, size, info)) {
+		return;
+	}
+	if ((options & lo_tcp_hc) && info.protocol == IpHeader::proto_tcp) {
+		switch (tcp_compressor.compress(data, size, header, header_size, original_size, slot)) {
+		case Vj::type_ip:
+			break;
+		case Vj::type_uncompressed:
+			*packet.data.push_front(1) = slot;
+			packet.frame_type = ft_tcp_uncompressed;
+			stats.inc_tcp_hc_uncompressed(1);
+			break;
+		case Vj::type_compressed:
+			packet.data.pop_front(original_size);
+			std::memcpy(packet.data.push_front(header_size), header, header_size);
+			packet.frame_type = ft_tcp_compressed;
+			stats.inc_tcp_hc_compressed(1);
+			stats.inc_tcp_hc_header_bytes(original_size);
+			stats.inc_tcp_hc_compressed_bytes(header_size);
+			break;
+		}
+	} else if ((options & lo_udp_hc) && info.protocol == IpHeader::proto_udp) {
+		switch (udp_compressor.compress(data, size, header, header_size, original_size, slot)) {
+		case Iphc::type_ip:
+			break;
+		case Iphc::type_full:
+			*packet.data.push_front(1) = slot;
+			packet.frame_type = ft_udp_full;
+			stats.inc_udp_hc_full(1);
+			break;
+		case Iphc::type_compressed:
+			packet.data.pop_front(original_size);
+			std::memcpy(packet.data.push_front(header_size), header, header_size);
+			packet.frame_type = ft_udp_compressed;
+			stats.inc_udp_hc_compressed(1);
+			stats.inc_udp_hc_header_bytes(original_size);
+			stats.inc_udp_hc_compressed_bytes(header_size);
+			break;
+		}
+	}
+}
+
+bool IpLink::tx_stream_compression() const
+{
+	return config.compression > 0 && config.compression_stream &&
+		(peer_link_options.value_or(0) & lo_lz_stream) && peer_lz_dictionary_id == lz_dictionary_id;
+}
+
+void IpLink::compress_frame(std::uint8_t& frame_type, const void *& data, size_t& size)
+{
+	const bool stream = tx_stream_compression();
+	if (config.compression == 0 || !(stream || (peer_link_options.value_or(0) & lo_lz)) || size < lz_min_size) {
+		return;
+	}
+	const auto p = static_cast<const std::uint8_t *>(data);
+	if (size >= lz_entropy_min_size && Lz::entropy(p, size) > lz_max_entropy) {
+		stats.inc_lz_bypassed(1);
+		return;
+	}
+	/* Little is queued for the UART, so favour speed over ratio */
+	int level = config.compression;
+	if (level > 1 && uart_tx_buf.size() < uart_queue_limit / 2) {
+		level = 1;
+		stats.inc_lz_fast_frames(1);
+	}
+	if (stream) {
+		/* Goes into history whether or not it compresses, so must be sent either way */
+		auto compressed_size = lz_stream_compressor.compress(p, size, &lz_tx_buf[lz_stream_header], level);
+		lz_tx_buf[0] = frame_type;
+		lz_tx_buf[1] = lz_tx_seq;
+		if (compressed_size == 0) {
+			lz_tx_buf[1] |= lz_stream_stored;
+			std::memcpy(&lz_tx_buf[lz_stream_header], p, size);
+			compressed_size = size;
+			stats.inc_lz_stream_stored(1);
+		}
+		lz_tx_seq = lz_tx_seq % lz_stream_seq_mask + 1;
+		stats.inc_lz_stream_frames(1);
+		stats.inc_lz_bytes_in(size);
+		stats.inc_lz_bytes_out(lz_stream_header + compressed_size);
+		frame_type = ft_lz_stream;
+		data = lz_tx_buf.data();
+		size = lz_stream_header + compressed_size;
+		return;
+	}
+	const auto compressed_size = lz_compressor.compress(p, size, &lz_tx_buf[1], level);
+	if (compressed_size == 0) {
+		stats.inc_lz_incompressible(1);
+		return;
+	}
+	lz_tx_buf[0] = frame_type;
+	stats.inc_lz_frames(1);
+	stats.inc_lz_bytes_in(size);
+	stats.inc_lz_bytes_out(1 + compressed_size);
+	frame_type = ft_lz;
+	data = lz_tx_buf.data();
+	size = 1 + compressed_size;
+}
+
+bool IpLink::decompress_frame(std::uint8_t& frame_type, void *& data, size_t& size)
+{
+	const auto p = static_cast<const std::uint8_t *>(data);
+	const auto decompressed_size = size >= 1 ? Lz::decompress(p + 1, size - 1, lz_rx_buf.data(), lz_rx_buf.size()) : 0;
+	if (decompressed_size == 0 || p[0] == ft_lz) {
+		stats.inc_lz_rx_errors(1);
+		std::cerr << "BADLZ: " << size << std::endl;
+		verbose_hexdump("UART =!> TUN [invalid compressed frame]", data, size);
+		return false;
+	}
+	frame_type = p[0];
+	data = lz_rx_buf.data();
+	size = decompressed_size;
+	return true;
+}
+
+bool IpLink::decompress_stream_frame(std::uint8_t& frame_type, void *& data, size_t& size)
+{
+	const auto p = static_cast<const std::uint8_t *>(data);
+	if (size < lz_stream_header) {
+		stats.inc_lz_rx_errors(1);
+		std::cerr << "BADLZ: " << size << std::endl;
+		return false;
+	}
+	const std::uint8_t seq = p[1] & lz_stream_seq_mask;
+	if (seq == 0) {
+		lz_stream_decompressor.reset();
+		lz_rx_seq = 0;
+	}
+	if (seq != lz_rx_seq) {
+		/* A stream frame was lost, our history no longer matches the peer's */
+		stats.inc_lz_stream_rx_dropped(1);
+		lz_rx_seq.reset();
+		if (lz_rx_dropped++ % lz_reset_retry == 0) {
+			request_stream_reset();
+		}
+		return false;
+	}
+	const auto payload = p + lz_stream_header;
+	const auto payload_size = size - lz_stream_header;
+	const auto decompressed_size = (p[1] & lz_stream_stored) ?
+		lz_stream_decompressor.store(payload, payload_size) :
+		lz_stream_decompressor.decompress(payload, payload_size);
+	if (decompressed_size == 0 || p[0] == ft_lz || p[0] == ft_lz_stream) {
+		stats.inc_lz_rx_errors(1);
+		std::cerr << "BADLZ: " << size << std::endl;
+		verbose_hexdump("UART =!> TUN [invalid stream frame]", data, size);
+		lz_rx_seq.reset();
+		lz_rx_dropped = 1;
+		request_stream_reset();
+		return false;
+	}
+	lz_rx_seq = seq % lz_stream_seq_mask + 1;
+	lz_rx_dropped = 0;
+	frame_type = p[0];
+	data = lz_stream_decompressor.data();
+	size = decompressed_size;
+	return true;
+}
+
+void IpLink::request_stream_reset()
+{
+	const std::uint8_t payload[] = { ft_lz_reset };
+	auto buffer = packet_pool.alloc(payload, sizeof(payload));
+	if (buffer) {
+		queue_packet(tx_control, 0, ft_lz_reset, std::move(buffer));
+		pump_tx();
+		rebind_serial_events();
+	} else {
+		stats.inc_tx_pool_drops(1);
+	}
+}
+
+void IpLink::reset_tx_stream()
+{
+	lz_stream_compressor.reset();
+	lz_tx_seq = 0;
 }
 
 void IpLink::write_packet(std::uint8_t frame_type, const void *data, size_t size)
 {
-	auto oit = std::back_inserter(uart_tx_buf);
-	oit = encoder.open(oit);
-	/* Write packet type */
-	oit = encoder.write(&frame_type, 1, oit);
-	/* Write payload */
-	oit = encoder.write(data, size, oit);
-	/* Write checksum */
-	const std::uint32_t cs = htonl(calc_checksum(data, size) ^ frame_type);
-	oit = encoder.write(&cs, sizeof(cs), oit);
-	oit = encoder.close(oit);
+	const bool reliable = arq_active() && !is_control(frame_type);
+	if (reliable && arq_sender->space() == 0) {
+		stats.inc_uart_tx_overflows(1);
+		return;
+	}
+	/*
+	 * A stream frame dropped once compressed would put the peer out of step,
+	 * so check for room beforehand, at worst case; encode_frame sizes any
+	 * other frame exactly
+	 */
+	if (!is_control(frame_type) && tx_stream_compression()) {
+		const auto max_raw_size = 1 + (reliable ? arq_header_size + 1 : 0) + lz_stream_header + size + frame_check.size();
+		const auto max_size = std::visit([&] (auto& encoder) {
+			return encoder.max_frame_length(fec ? fec->encoded_size(max_raw_size) : max_raw_size);
+		}, encoder);
+		if (uart_tx_buf.space() < max_size) {
+			stats.inc_uart_tx_overflows(1);
+			return;
+		}
+	}
+	/* Control frames must be readable whatever state the peer's decompressor is in */
+	if (!is_control(frame_type)) {
+		compress_frame(frame_type, data, size);
+	}
+	if (reliable) {
+		arq_send(frame_type, data, size);
+	} else {
+		encode_frame(frame_type, data, size);
+	}
 }
 
-std::tuple<std::uint8_t, void *, size_t> IpLink::read_packet()
+bool IpLink::encode_frame(std::uint8_t frame_type, const void *data, size_t size)
+{
+	const auto raw_size = 1 + size + frame_check.size();
+	/* Parity covers the whole frame, so it is built first */
+	const auto coded_size = fec ? fec_encode_frame(frame_type, data, size) : raw_size;
+	const auto frame_size = std::visit([&] (auto& encoder) {
+		/* Encode straight into the transmit queue, sized exactly but for the checksum which is not known yet */
+		const auto room = fec ?
+			encoder.frame_length(fec_tx_buf[0], &fec_tx_buf[1], coded_size - 1, 0) :
+			encoder.frame_length(frame_type, data, size, frame_check.size());
+		if (uart_tx_buf.space() < room) {
+			return std::size_t(0);
+		}
+		const auto begin = uart_tx_buf.write_data();
+		auto oit = begin;
+		oit = encoder.open(oit);
+		if (fec) {
+			oit = encoder.write(fec_tx_buf.data(), coded_size, oit);
+			return std::size_t(encoder.close(oit) - begin);
+		}
+		/* Write packet type */
+		oit = encoder.write(&frame_type, 1, oit);
+		/* Write payload, computing checksum in the same pass */
+		auto sum = frame_check.start(frame_type);
+		oit = encoder.write(data, size, oit, [&] (const std::uint8_t *chunk, std::size_t chunk_size) {
+			frame_check.update(sum, chunk, chunk_size);
+		});
+		/* Write checksum */
+		std::uint8_t cs[4];
+		oit = encoder.write(cs, frame_check.store(frame_check.finish(sum), cs), oit);
+		oit = encoder.close(oit);
+		return std::size_t(oit - begin);
+	}, encoder);
+	if (frame_size == 0) {
+		stats.inc_uart_tx_overflows(1);
+		return false;
+	}
+	uart_tx_buf.commit(frame_size);
+	stats.inc_fec_tx_parity_bytes(coded_size - raw_size);
+	if (std::holds_alternative<Cobs::Encoder>(encoder)) {
+		stats.inc_cobs_overhead_bytes(frame_size - coded_size);
+	} else {
+		stats.inc_kiss_overhead_bytes(frame_size - coded_size);
+	}
+	return true;
+}
+
+bool IpLink::arq_active() const
+{
+	return arq_sender && peer_arq_session && (peer_link_options.value_or(0) & lo_arq);
+}
+
+bool IpLink::arq_window_closed(int tx_class) const
+{
+	if (tx_class == tx_control || !arq_active()) {
+		return false;
+	}
+	/* A pending aggregate holds a place, in case the next packet does not fit it */
+	return arq_sender->space() < (tx_aggregate_count > 0 ? 2u : 1u);
+}
+
+void IpLink::arq_send(std::uint8_t frame_type, const void *data, size_t size)
+{
+	const auto seq = arq_sender->push(&frame_type, 1, data, size);
+	stats.inc_arq_frames(1);
+	arq_transmit(seq);
+}
+
+void IpLink::arq_transmit(std::uint8_t seq)
+{
+	auto p = arq_tx_buf.data();
+	p[0] = *peer_arq_session;
+	p[1] = seq;
+	const auto header_size = 2 + arq_store_ack(p + 2);
+	const auto size = arq_sender->size(seq);
+	std::memcpy(p + header_size, arq_sender->data(seq), size);
+	/* If there is no room it is as good as lost on the line, and is resent on timeout */
+	encode_frame(ft_arq, p, header_size + size);
+	arq_sender->sent(seq, Arq::Clock::now());
+	arq_update_timer();
+}
+
+std::size_t IpLink::arq_store_ack(std::uint8_t *out)
+{
+	arq_unacked = 0;
+	arq_ack_now = false;
+	return arq_receiver->ack().store(out);
+}
+
+void IpLink::arq_send_ack()
+{
+	std::uint8_t payload[1 + Arq::max_ack];
+	payload[0] = *peer_arq_session;
+	const auto size = 1 + arq_store_ack(payload + 1);
+	if (encode_frame(ft_arq_ack, payload, size)) {
+		stats.inc_arq_acks(1);
+	}
+}
+
+bool IpLink::arq_handle_frame(const std::uint8_t *frame, std::size_t size)
+{
+	Arq::Ack ack;
+	switch (frame[0]) {
+	case ft_arq:
+		if (!arq_receive(frame + 1, size - 1)) {
+			stats.inc_arq_rx_errors(1);
+			verbose_hexdump("UART =!> TUN [invalid or stale ARQ frame]", frame, size);
+		}
+		return true;
+	case ft_arq_ack:
+		if (size >= 2 && frame[1] == arq_session && ack.load(frame + 2, size - 2) != 0) {
+			arq_acknowledge(ack);
+		} else {
+			stats.inc_arq_rx_errors(1);
+		}
+		return true;
+	case ft_keepalive:
+		/* Type, marker, options, dictionary, options, then the ARQ fields */
+		if (size >= 8) {
+			if (peer_arq_session && *peer_arq_session != frame[6]) {
+				/* Peer restarted its numbering, so it has forgotten ours too */
+				arq_restart();
+			}
+			peer_arq_session = frame[6];
+			if (frame[7] == arq_session && ack.load(frame + 8, size - 8) != 0) {
+				arq_acknowledge(ack);
+			}
+		}
+		/* Still delivered, for its link options */
+		return false;
+	default:
+		return false;
+	}
+}
+
+bool IpLink::arq_receive(const std::uint8_t *data, std::size_t size)
+{
+	Arq::Ack ack;
+	if (size < 2 || data[0] != arq_session) {
+		return false;
+	}
+	const auto seq = data[1];
+	const auto ack_size = ack.load(data + 2, size - 2);
+	const auto header_size = 2 + ack_size;
+	if (ack_size == 0 || size <= header_size || size - header_size > max_frame_size(config)) {
+		return false;
+	}
+	arq_acknowledge(ack);
+	switch (arq_receiver->receive(seq, data + header_size, size - header_size)) {
+	case Arq::Receiver::accepted:
+		/* Like TCP, acknowledge every second frame at once */
+		if (++arq_unacked >= 2) {
+			arq_ack_now = true;
+		} else {
+			arq_schedule_ack();
+		}
+		break;
+	case Arq::Receiver::early:
+		/* Tell the sender about the gap straight away */
+		stats.inc_arq_rx_out_of_order(1);
+		arq_unacked++;
+		arq_ack_now = true;
+		break;
+	case Arq::Receiver::duplicate:
+		/* Our acknowledgement was lost */
+		stats.inc_arq_rx_duplicates(1);
+		arq_unacked++;
+		arq_ack_now = true;
+		break;
+	}
+	arq_release();
+	return true;
+}
+
+void IpLink::arq_acknowledge(const Arq::Ack& ack)
 {
-	/* Get packet from queue */
-	buffer = std::move(uart_rx_buf.front());
-	uart_rx_buf.pop_front();
-	/* Validate packet */
-	auto p = static_cast<std::uint8_t *>(buffer.data());
-	auto size = buffer.size();
-	if (size < 5) {
+	const auto rtt = arq_sender->acknowledge(ack, Arq::Clock::now());
+	if (rtt) {
+		stats.inc_arq_rtt_samples(1);
+		stats.inc_arq_rtt_us(std::chrono::duration_cast<std::chrono::microseconds>(*rtt).count());
+	}
+	if (arq_sender->space() > 0) {
+		arq_stalled = false;
+	}
+	arq_sender->for_each_lost([this] (std::uint8_t seq) {
+		stats.inc_arq_retransmits(1);
+		arq_transmit(seq);
+	});
+	arq_update_timer();
+}
+
+std::size_t IpLink::arq_release()
+{
+	std::size_t count = 0;
+	/* Frames left held once the receive queue fills are released as it drains */
+	arq_receiver->release([this, &count] (const std::uint8_t *data, std::size_t size) {
+		if (!uart_rx_buf.push(data, size)) {
+			return false;
+		}
+		count++;
+		return true;
+	});
+	return count;
+}
+
+void IpLink::arq_schedule_ack()
+{
+	if (!arq_ack_armed) {
+		arq_ack_armed = true;
+		update_timer_us(arq_ack, arq_ack_delay_us);
+	}
+}
+
+void IpLink::arq_update_timer()
+{
+	const auto deadline = arq_sender->deadline();
+	if (!deadline) {
+		arq_rto.disarm();
+		return;
+	}
+	const auto delay = std::chrono::duration_cast<std::chrono::microseconds>(*deadline - Arq::Clock::now()).count();
+	update_timer_us(arq_rto, std::max<std::int64_t>(1, delay));
+}
+
+void IpLink::arq_restart()
+{
+	arq_sender->reset();
+	arq_receiver->reset();
+	arq_unacked = 0;
+	arq_ack_now = false;
+	arq_stalled = false;
+	arq_rto.disarm();
+	/* Discarded frames may have carried compression state */
+	tcp_compressor.reset();
+	udp_compressor.reset();
+	reset_tx_stream();
+	tcp_decompressor.toss();
+}
+
+void IpLink::arq_reset()
+{
+	arq_restart();
+	arq_session = arq_session % 255 + 1;
+	peer_arq_session.reset();
+}
+
+std::size_t IpLink::fec_encode_frame(std::uint8_t frame_type, const void *data, size_t size)
+{
+	auto p = fec_tx_raw_buf.data();
+	p[0] = frame_type;
+	std::memcpy(p + 1, data, size);
+	const auto raw_size = 1 + size + frame_check.store(frame_check.compute(frame_type, data, size), p + 1 + size);
+	return fec->encode(p, raw_size, fec_tx_buf.data());
+}
+
+void IpLink::fec_correct_frame(std::uint8_t *frame, std::size_t& size)
+{
+	/* An uncorrectable frame is still passed on, it may only have lost parity bytes */
+	const auto corrected = fec->decode(frame, size);
+	if (corrected > 0) {
+		stats.inc_fec_corrected_frames(1);
+		stats.inc_fec_corrected_bytes(corrected);
+	} else if (corrected < 0) {
+		stats.inc_fec_uncorrectable_frames(1);
+	}
+}
+
+bool IpLink::verify_frame(const std::uint8_t *frame, std::size_t size)
+{
+	const auto cs_size = frame_check.size();
+	if (size < 1 + cs_size) {
 		std::cerr << "TOOSMALL: " << size << std::endl;
-		verbose_hexdump("UART =!> TUN [invalid length]", buffer.data(), buffer.size());
+		verbose_hexdump("UART =!> TUN [invalid length]", frame, size);
 		stats.inc_uart_rx_errors(1);
-		return { 0, nullptr, 0 };
-	}
-	std::uint8_t frame_type = *p;
-	/* Verify checksum */
-	std::uint32_t cs_expect = ntohl(*static_cast<std::uint32_t *>(static_cast<void *>(&p[size - 4])));
-	p++;
-	size -= 5;
-	std::uint32_t cs_actual = calc_checksum(p, size) ^ frame_type;
+		return false;
+	}
+	/* Checksum has been run over the frame while it was decoded, unless it has since been corrected */
+	std::uint32_t cs_expect = frame_check.load(&frame[size - cs_size]);
+	std::uint32_t cs_actual = fec ?
+		frame_check.compute(frame[0], frame + 1, size - 1 - cs_size) :
+		frame_verifier.finish(frame, size);
 	if (cs_expect != cs_actual) {
 		std::cerr << "CSFAIL: " << std::hex << cs_expect << " != " << cs_actual << std::dec << std::endl;
-		verbose_hexdump("UART =!> TUN [checksum fail]", buffer.data(), buffer.size());
+		verbose_hexdump("UART =!> TUN [checksum fail]", frame, size);
 		stats.inc_uart_rx_errors(1);
-		return { 0, nullptr, 0 };
+		return false;
 	}
-	return { frame_type, p, size };
+	return true;
+}
+
+std::tuple<std::uint8_t, void *, size_t> IpLink::read_packet()
+{
+	/* Get packet from queue, it was verified when decoded */
+	auto p = uart_rx_buf.front_data();
+	auto size = uart_rx_buf.front_size();
+	uart_rx_buf.pop();
+	return { p[0], p + 1, size - 1 };
 }
 
 void IpLink::on_tun_writable()
+{
+	for (int i = 0; i < tun_tx_budget && !uart_rx_buf.empty(); i++) {
+		deliver_packet();
+	}
+	/* Window moves on once held frames are released */
+	if (arq_receiver && arq_release() > 0) {
+		arq_unacked++;
+		arq_schedule_ack();
+	}
+}
+
+void IpLink::deliver_packet()
 {
 	std::uint8_t frame_type;
 	void *data;
 	std::size_t size;
 	std::tie(frame_type, data, size) = read_packet();
-	if (data == nullptr) {
+	if (frame_type == ft_lz && !decompress_frame(frame_type, data, size)) {
 		return;
 	}
+	if (frame_type == ft_lz_stream && !decompress_stream_frame(frame_type, data, size)) {
+		return;
+	}
+	if (frame_type == ft_aggregate) {
+		deliver_aggregate(data, size);
+	} else if (frame_type == ft_fragment) {
+		deliver_fragment(data, size);
+	} else {
+		deliver_frame(frame_type, data, size);
+	}
+}
+
+void IpLink::deliver_aggregate(void *data, size_t size)
+{
+	auto p = static_cast<std::uint8_t *>(data);
+	const auto end = p + size;
+	stats.inc_rx_aggregates(1);
+	while (p != end) {
+		/* Type and length, which may take a second byte */
+		if (end - p < 2 || ((p[1] & 0x80) && end - p < 3)) {
+			break;
+		}
+		const auto frame_type = *p++;
+		std::size_t item_size = *p++;
+		if (item_size & 0x80) {
+			item_size = (item_size & 0x7f) << 8 | *p++;
+		}
+		if (item_size > std::size_t(end - p)) {
+			break;
+		}
+		/* Anything but a plain frame (an aggregate, or compressed frame) is rejected as an invalid type */
+		deliver_frame(frame_type, p, item_size);
+		p += item_size;
+	}
+	if (p != end) {
+		stats.inc_rx_aggregate_errors(1);
+		std::cerr << "BADAGG: " << size << std::endl;
+		verbose_hexdump("UART =!> TUN [invalid aggregate]", data, size);
+	}
+}
+
+void IpLink::deliver_fragment(void *data, size_t size)
+{
+	const auto p = static_cast<std::uint8_t *>(data);
+	stats.inc_rx_fragments(1);
+	if (size <= fragment_header_size) {
+		stats.inc_uart_rx_errors(1);
+		std::cerr << "TOOSMALLFRAG: " << size << std::endl;
+		drop_reassembly();
+		return;
+	}
+	const std::uint8_t id = p[0];
+	const std::uint8_t index = p[1] & fragment_index_mask;
+	const auto piece_size = size - fragment_header_size;
+	if (index == 0) {
+		/* Any frame still being reassembled has lost its end */
+		drop_reassembly();
+		rx_fragment_id = id;
+		rx_fragment_size = 0;
+		rx_fragment_index = 0;
+	} else if (rx_fragment_id != id || index != rx_fragment_index) {
+		/* A fragment was lost, the rest of its frame is of no use */
+		drop_reassembly();
+		return;
+	}
+	if (rx_fragment_size + piece_size > rx_fragment_buf.size()) {
+		drop_reassembly();
+		return;
+	}
+	std::memcpy(&rx_fragment_buf[rx_fragment_size], p + fragment_header_size, piece_size);
+	rx_fragment_size += piece_size;
+	rx_fragment_index++;
+	if (!(p[1] & fragment_last)) {
+		update_timer(rx_reassembly, reassembly_timeout_ms(config));
+		return;
+	}
+	rx_fragment_id.reset();
+	rx_reassembly.disarm();
+	stats.inc_rx_reassembled_frames(1);
+	/* Only plain frames are fragmented: an aggregate or fragment inside is rejected as an invalid type */
+	deliver_frame(rx_fragment_buf[0], &rx_fragment_buf[1], rx_fragment_size - 1);
+}
+
+void IpLink::drop_reassembly()
+{
+	if (rx_fragment_id) {
+		rx_fragment_id.reset();
+		rx_reassembly.disarm();
+		stats.inc_rx_reassembly_errors(1);
+		verbose_hexdump("UART =!> TUN [incomplete fragmented frame]", rx_fragment_buf.data(), rx_fragment_size);
+	}
+}
+
+void IpLink::deliver_frame(std::uint8_t frame_type, void *data, size_t size)
+{
 	if (frame_type == ft_keepalive) {
 		on_received_keepalive();
-	} else if (frame_type == ft_ip_packet) {
-		if (size < 20 + sizeof(struct tun_frame_info)) {
+		check_link_options(data, size);
+	} else if (frame_type == ft_lz_reset) {
+		on_received_keepalive();
+		reset_tx_stream();
+		stats.inc_lz_stream_resets(1);
+	} else if (frame_type == ft_ip_packet || frame_type == ft_ip_bare) {
+		const auto info_size = frame_type == ft_ip_packet ? sizeof(struct tun_frame_info) : 0;
+		if (size < 20 + info_size) {
 			stats.inc_uart_rx_errors(1);
 			std::cerr << "TOOSMALLIP: " << size << std::endl;
 			verbose_hexdump("UART =!> TUN [invalid IP packet length]", data, size);
 			return;
 		}
 		on_received_keepalive();
-		Frame frame(data, size);
-		tun.send(frame);
-		stats.inc_tun_tx_frames(1);
-		stats.inc_tun_tx_bytes(frame.size - sizeof(struct tun_frame_info));
-		verbose_hexdump("UART ==> TUN", frame.buffer, frame.size);
+		const auto packet = static_cast<std::uint8_t *>(data) + info_size;
+		const auto packet_size = size - info_size;
+		if (frame_type == ft_ip_packet && !config.tun_no_pi) {
+			tun.send(Frame(data, size));
+			stats.inc_tun_tx_frames(1);
+			stats.inc_tun_tx_bytes(packet_size);
+		} else {
+			send_to_tun(packet, packet_size, nullptr, 0);
+		}
+		verbose_hexdump("UART ==> TUN", data, size);
+	} else if (frame_type == ft_tcp_uncompressed) {
+		on_received_keepalive();
+		const auto packet = static_cast<std::uint8_t *>(data);
+		if (size < 1 || !tcp_decompressor.remember(packet[0], packet + 1, size - 1)) {
+			stats.inc_tcp_hc_rx_errors(1);
+			std::cerr << "BADSLOT: " << size << std::endl;
+			verbose_hexdump("UART =!> TUN [invalid uncompressed TCP]", data, size);
+			return;
+		}
+		send_to_tun(packet + 1, size - 1, nullptr, 0);
+		verbose_hexdump("UART ==> TUN", data, size);
+	} else if (frame_type == ft_tcp_compressed) {
+		on_received_keepalive();
+		const auto packet = static_cast<std::uint8_t *>(data);
+		std::uint8_t header[Vj::max_header];
+		std::size_t consumed;
+		const auto header_size = tcp_decompressor.decompress(packet, size, header, consumed);
+		if (header_size == 0) {
+			/* Context lost, wait for the sender to re-establish it */
+			stats.inc_tcp_hc_rx_tossed(1);
+			verbose_hexdump("UART =!> TUN [tossed compressed TCP]", data, size);
+			return;
+		}
+		send_to_tun(header, header_size, packet + consumed, size - consumed);
+		verbose_hexdump("UART ==> TUN", data, size);
+	} else if (frame_type == ft_udp_full) {
+		on_received_keepalive();
+		const auto packet = static_cast<std::uint8_t *>(data);
+		if (size < 1 || !udp_decompressor.remember(packet[0], packet + 1, size - 1)) {
+			stats.inc_udp_hc_rx_errors(1);
+			std::cerr << "BADSLOT: " << size << std::endl;
+			verbose_hexdump("UART =!> TUN [invalid full UDP]", data, size);
+			return;
+		}
+		send_to_tun(packet + 1, size - 1, nullptr, 0);
+		verbose_hexdump("UART ==> TUN", data, size);
+	} else if (frame_type == ft_udp_compressed) {
+		on_received_keepalive();
+		const auto packet = static_cast<std::uint8_t *>(data);
+		std::uint8_t header[Iphc::max_header];
+		std::size_t consumed;
+		const auto header_size = udp_decompressor.decompress(packet, size, header, consumed);
+		if (header_size == 0) {
+			/* Context lost or stale, wait for the next full header */
+			stats.inc_udp_hc_rx_errors(1);
+			verbose_hexdump("UART =!> TUN [unknown UDP context]", data, size);
+			return;
+		}
+		send_to_tun(header, header_size, packet + consumed, size - consumed);
+		verbose_hexdump("UART ==> TUN", data, size);
 	} else {
 		stats.inc_uart_rx_errors(1);
 		std::cerr << "INVALIDTYPE: " << frame_type << std::endl;
@@ -345,12 +1765,77 @@ void IpLink::on_tun_writable()
 	}
 }
 
-static constexpr Linux::Flags flags = Linux::close_on_exec | Linux::non_blocking;
+void IpLink::send_to_tun(const void *header, size_t header_size, const void *payload, size_t payload_size)
+{
+	struct tun_frame_info info;
+	struct iovec iov[3];
+	int count = 0;
+	if (!config.tun_no_pi) {
+		info = make_frame_info(header, header_size);
+		iov[count++] = { &info, sizeof(info) };
+	}
+	iov[count++] = { const_cast<void *>(header), header_size };
+	if (payload_size > 0) {
+		iov[count++] = { const_cast<void *>(payload), payload_size };
+	}
+	tun.send(iov, count);
+	stats.inc_tun_tx_frames(1);
+	stats.inc_tun_tx_bytes(header_size + payload_size);
+}
 
-#define bind_handler(method) \
-	[this] (auto events) { \
-		method(events); \
+IpLink::Encoder IpLink::make_encoder(const Config& config)
+{
+	if (config.framing == "cobs") {
+		return Cobs::Encoder();
+	} else {
+		return Kiss::Encoder();
 	}
+}
+
+IpLink::Decoder IpLink::make_decoder(const Config& config)
+{
+	if (config.framing == "cobs") {
+		return Cobs::Decoder(max_coded_frame_size(config));
+	} else {
+		return Kiss::Decoder(max_coded_frame_size(config));
+	}
+}
+
+FrameCheck IpLink::make_frame_check(const Config& config)
+{
+	if (config.checksum == "crc32c") {
+		return FrameCheck(FrameCheck::check_crc32c);
+	} else if (config.checksum == "none") {
+		return FrameCheck(FrameCheck::check_none);
+	} else {
+		return FrameCheck(FrameCheck::check_legacy);
+	}
+}
+
+std::vector<std::uint8_t> IpLink::load_dictionary(const Config& config)
+{
+	if (config.dictionary.empty()) {
+		return {};
+	}
+	std::ifstream is(config.dictionary, std::ios::binary);
+	if (!is) {
+		throw std::runtime_error("Failed to open dictionary \"" + config.dictionary + "\"");
+	}
+	return { std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>() };
+}
+
+Codel IpLink::make_codel(const Config& config)
+{
+	/*
+	 * Target must cover serialisation of a full-size frame (ten bit times
+	 * per byte), else a slow link would be permanently "above target"
+	 */
+	const auto target = std::max<Codel::Duration>(codel_target, std::chrono::duration_cast<Codel::Duration>(frame_time(config)));
+	const auto interval = std::max<Codel::Duration>(codel_interval, 4 * target);
+	return Codel(target, interval, max_frame_size(config));
+}
+
+static constexpr Linux::Flags flags = Linux::close_on_exec | Linux::non_blocking;
 
 IpLink::IpLink(const Config& config) :
 	config(config),
@@ -358,22 +1843,89 @@ IpLink::IpLink(const Config& config) :
 	meter_timer(Linux::Clock::monotonic, flags),
 	send_ka(Linux::Clock::monotonic, flags),
 	recv_ka(Linux::Clock::monotonic, flags),
+	tx_pace(Linux::Clock::monotonic, flags),
+	tx_linger(Linux::Clock::monotonic, flags),
+	rx_reassembly(Linux::Clock::monotonic, flags),
+	arq_rto(Linux::Clock::monotonic, flags),
+	arq_ack(Linux::Clock::monotonic, flags),
 	uart(config.uart, config.baud, flags),
-	tun(config.ifname, flags),
+	tun(config.ifname, flags, config.tun_no_pi),
 	epfd(Flags::close_on_exec),
-	decoder(sizeof(struct tun_frame_info) + config.mtu)
+	uart_rx_buf(2 * uart_read_size + 4 * max_frame_size(config)),
+	uart_tx_buf(uart_tx_capacity),
+	packet_pool(tx_pool_size, sizeof(struct tun_frame_info) + config.mtu),
+	tx_queues{{
+		FairQueue(1, max_frame_size(config), tx_control_limit, make_codel(config)),
+		FairQueue(tx_interactive_flows, max_frame_size(config), tx_interactive_limit, make_codel(config)),
+		FairQueue(tx_bulk_flows, max_frame_size(config), tx_bulk_limit, make_codel(config)) }},
+	uart_queue_limit(std::max<std::size_t>(uart_queue_min, std::size_t(config.baud) / 10 * config.uart_queue_ms / 1000)),
+	tx_bucket(config.tx_rate > 0 ?
+		std::make_optional<TokenBucket>(config.tx_rate / 10.0, max_coded_frame_size(config)) :
+		std::nullopt),
+	uart_rx_high_water(uart_rx_buf.capacity() - uart_read_size - 2 * max_frame_size(config)),
+	uart_read_buf(uart_read_size),
+	tun_rx_frame(sizeof(struct tun_frame_info) + config.mtu),
+	encoder(make_encoder(config)),
+	decoder(make_decoder(config)),
+	frame_check(make_frame_check(config)),
+	frame_verifier(frame_check),
+	fec(config.fec_parity > 0 ? std::make_optional<ReedSolomon::Codec>(config.fec_parity) : std::nullopt),
+	fec_tx_raw_buf(fec ? max_frame_size(config) : 0),
+	fec_tx_buf(fec ? max_coded_frame_size(config) : 0),
+	fec_rx_buf(fec ? max_coded_frame_size(config) : 0),
+	tcp_compressor(tcp_hc_slots),
+	tcp_decompressor(tcp_hc_slots),
+	udp_compressor(udp_hc_slots),
+	udp_decompressor(udp_hc_slots),
+	lz_compressor(max_frame_size(config)),
+	lz_tx_buf(max_frame_size(config)),
+	lz_rx_buf(max_frame_size(config)),
+	lz_dictionary(load_dictionary(config)),
+	lz_dictionary_id(dictionary_id(lz_dictionary)),
+	lz_stream_compressor(lz_stream_window, max_frame_size(config), lz_dictionary),
+	lz_stream_decompressor(lz_stream_window, max_frame_size(config), lz_dictionary),
+	tx_aggregate_buf(sizeof(struct tun_frame_info) + config.mtu),
+	tx_fragment_payload(fragment_payload(config)),
+	tx_fragment_buf(tx_fragment_payload > 0 ? fragment_header_size + max_frame_size(config) : 0),
+	rx_fragment_buf(tx_fragment_payload > 0 ? max_frame_size(config) : 0),
+	arq_sender(config.arq ?
+		std::make_optional<Arq::Sender>(config.arq_window, max_frame_size(config), arq_rto_floor(config)) :
+		std::nullopt),
+	arq_receiver(config.arq ? std::make_optional<Arq::Receiver>(max_frame_size(config)) : std::nullopt),
+	arq_tx_buf(config.arq ? arq_header_size + max_frame_size(config) : 0),
+	arq_session(make_arq_session()),
+	link_options(
+		(config.framing == "cobs" ? lo_cobs : 0) |
+		(config.checksum == "crc32c" ? lo_crc32c : 0) |
+		(config.checksum == "none" ? lo_no_check : 0) |
+		(config.header_compression ? lo_tcp_hc | lo_udp_hc : 0) |
+		(config.aggregate ? lo_aggregate : 0) |
+		(config.arq ? lo_arq : 0) |
+		(config.fragment_ms > 0 ? lo_fragment : 0) |
+		lo_bare_ip | lo_lz | lo_lz_stream)
 {
 	tun.set_point_to_point(true);
 	tun.set_mtu(config.mtu);
 	tun.set_addr(config.addr.get_address(), config.addr.get_mask());
 	// tun.set_route(remote_addr, 1, remote_addr, link_mask);
 
-	epfd.bind(sfd, bind_handler(on_signal), Events::event_in);
-	epfd.bind(meter_timer, bind_handler(on_update_meter), Events::event_in);
-	epfd.bind(send_ka, bind_handler(on_send_ka_timer), Events::event_in);
-	epfd.bind(recv_ka, bind_handler(on_recv_ka_timer), Events::event_in);
-	epfd.bind(uart, bind_handler(on_serial), Events::event_in);
-	epfd.bind(tun, bind_handler(on_tun), Events::event_in);
+	epfd.bind_id(sfd, slot_signal, Events::event_in);
+	epfd.bind_id(meter_timer, slot_meter, Events::event_in);
+	epfd.bind_id(send_ka, slot_send_ka, Events::event_in);
+	epfd.bind_id(recv_ka, slot_recv_ka, Events::event_in);
+	epfd.bind_id(tx_pace, slot_tx_pace, Events::event_in);
+	epfd.bind_id(tx_linger, slot_tx_linger, Events::event_in);
+	epfd.bind_id(rx_reassembly, slot_rx_reassembly, Events::event_in);
+	epfd.bind_id(arq_rto, slot_arq_rto, Events::event_in);
+	epfd.bind_id(arq_ack, slot_arq_ack, Events::event_in);
+	if (config.edge_triggered) {
+		/* Interest never changes, readiness is tracked in service_ready */
+		epfd.bind_id(uart, slot_serial, Events::event_in | Events::event_out, Linux::EpollFD::trigger_edge);
+		epfd.bind_id(tun, slot_tun, Events::event_in | Events::event_out, Linux::EpollFD::trigger_edge);
+	} else {
+		epfd.bind_id(uart, slot_serial, Events::event_in);
+		epfd.bind_id(tun, slot_tun, Events::event_in);
+	}
 
 	if (!config.updown) {
 		set_tun_updown(true);
@@ -398,7 +1950,15 @@ void IpLink::run()
 	send_keepalive();
 	rebind_events();
 	while (!terminating) {
-		epfd.wait();
+		/* With edge-triggering, only block once every descriptor has run dry */
+		const bool busy = config.edge_triggered && has_ready_work();
+		stats.inc_loop_wakeups(1);
+		stats.inc_loop_events(epfd.dispatch([this] (std::uint64_t slot, Events events) {
+			on_event(slot, events);
+		}, epoll_batch, busy ? 0 : -1));
+		if (config.edge_triggered) {
+			service_ready();
+		}
 	}
 	if (config.meter) {
 		std::cerr << std::endl;
@@ -4,13 +4,27 @@
 
 #include <list>
 #include <deque>
+#include <array>
 #include <vector>
+#include <variant>
+#include <optional>
 
 #include "Linux.hpp"
 #include "Serial.hpp"
 #include "Tun.hpp"
 
 #include "Kiss.hpp"
+#include "Cobs.hpp"
+#include "FrameCheck.hpp"
+#include "ReedSolomon.hpp"
+#include "PacketRing.hpp"
+#include "ByteRing.hpp"
+#include "FairQueue.hpp"
+#include "TokenBucket.hpp"
+#include "Vj.hpp"
+#include "Iphc.hpp"
+#include "Lz.hpp"
+#include "Arq.hpp"
 
 #include "Meter.hpp"
 
@@ -30,6 +44,11 @@ class IpLink
 	Linux::TimerFD meter_timer;
 	Linux::TimerFD send_ka;
 	Linux::TimerFD recv_ka;
+	Linux::TimerFD tx_pace;
+	Linux::TimerFD tx_linger;
+	Linux::TimerFD rx_reassembly;
+	Linux::TimerFD arq_rto;
+	Linux::TimerFD arq_ack;
 	Linux::Serial uart;
 	Linux::Tun tun;
 	Linux::EpollFD epfd;
@@ -43,19 +62,220 @@ class IpLink
 	bool is_connected{false};
 	bool tun_up{false};
 
+	/* Edge-triggered mode: descriptors which have not yet run dry */
+	bool serial_readable{false};
+	bool serial_writable{false};
+	bool tun_readable{false};
+	bool tun_writable{false};
+
 	int missed_keepalives{1};
 
-	std::list<std::vector<std::uint8_t>> uart_rx_buf;
-	std::deque<std::uint8_t> uart_tx_buf;
+	PacketRing uart_rx_buf;
+	ByteRing uart_tx_buf;
+
+	/* Transmit classes, served in strict priority order */
+	enum TxClass {
+		tx_control,
+		tx_interactive,
+		tx_bulk,
+		tx_class_count
+	};
+	/* Queued frames live here, declared first so it outlives the queues */
+	PacketPool packet_pool;
+	/* Each class is fair-queued by flow, AQM is not applied to control frames */
+	std::array<FairQueue, tx_class_count> tx_queues;
+
+	/* Bytes allowed in the serial driver's queue */
+	std::size_t uart_queue_limit;
+	/* Optional rate cap below line rate */
+	std::optional<TokenBucket> tx_bucket;
+	/* Waiting for the driver queue or token bucket to drain */
+	bool tx_paced{false};
+
+	/* Stop reading the UART above this, so a whole read can still be queued */
+	std::size_t uart_rx_high_water;
+
+	/* Sized once, UART reads land here */
+	std::vector<std::uint8_t> uart_read_buf;
+	/* TUN reads land here (and are dropped) when the packet pool is exhausted */
+	Frame tun_rx_frame;
+
+	using Encoder = std::variant<Kiss::Encoder, Cobs::Encoder>;
+	using Decoder = std::variant<Kiss::Decoder, Cobs::Decoder>;
+
+	Encoder encoder;
+	Decoder decoder;
+
+	FrameCheck frame_check;
+	FrameVerifier frame_verifier;
+
+	/* Optional forward error correction, frames are coded into and corrected in these */
+	std::optional<ReedSolomon::Codec> fec;
+	std::vector<std::uint8_t> fec_tx_raw_buf;
+	std::vector<std::uint8_t> fec_tx_buf;
+	std::vector<std::uint8_t> fec_rx_buf;
 
-	std::vector<std::uint8_t> buffer;
+	/* TCP/IP and UDP/IP header compression, state is per direction */
+	Vj::Compressor tcp_compressor;
+	Vj::Decompressor tcp_decompressor;
+	Iphc::Compressor udp_compressor;
+	Iphc::Decompressor udp_decompressor;
 
-	Kiss::Encoder encoder;
-	Kiss::Decoder decoder;
+	/* Payload compression, frames are compressed into and decompressed from these */
+	Lz::Compressor lz_compressor;
+	std::vector<std::uint8_t> lz_tx_buf;
+	std::vector<std::uint8_t> lz_rx_buf;
 
-	/* Writes and encodes packet */
+	/* Stream compression: history spans frames, in step with the peer's */
+	std::vector<std::uint8_t> lz_dictionary;
+	std::uint16_t lz_dictionary_id;
+	std::uint16_t peer_lz_dictionary_id{0};
+	Lz::StreamCompressor lz_stream_compressor;
+	Lz::StreamDecompressor lz_stream_decompressor;
+	/* Sequence of next stream frame sent, zero tells the peer to reset */
+	std::uint8_t lz_tx_seq{0};
+	/* Sequence of next stream frame expected, none when out of step */
+	std::optional<std::uint8_t> lz_rx_seq;
+	/* Stream frames dropped since we last asked the peer to reset */
+	unsigned lz_rx_dropped{0};
+
+	/* Packets dequeued together, sent as one frame of [type][length][packet] entries */
+	std::vector<std::uint8_t> tx_aggregate_buf;
+	std::size_t tx_aggregate_size{0};
+	std::size_t tx_aggregate_count{0};
+	/* Partial aggregate is waiting for more packets */
+	bool tx_lingering{false};
+
+	/*
+	 * Bulk packet being sent as fragments, preceded by room for the fragment
+	 * header (each header overwrites the tail of the fragment before)
+	 */
+	std::size_t tx_fragment_payload;
+	std::vector<std::uint8_t> tx_fragment_buf;
+	std::size_t tx_fragment_size{0};
+	std::size_t tx_fragment_offset{0};
+	std::uint8_t tx_fragment_index{0};
+	std::uint8_t tx_fragment_id{0};
+	/* Frame being reassembled, and the fragment expected next */
+	std::vector<std::uint8_t> rx_fragment_buf;
+	std::size_t rx_fragment_size{0};
+	std::optional<std::uint8_t> rx_fragment_id;
+	std::uint8_t rx_fragment_index{0};
+
+	/* Optional link-layer retransmission: frames awaiting acknowledgement, or delivery in order */
+	std::optional<Arq::Sender> arq_sender;
+	std::optional<Arq::Receiver> arq_receiver;
+	/* Numbered frames are written here, with their header */
+	std::vector<std::uint8_t> arq_tx_buf;
+	/*
+	 * Nonzero, advertised in keep-alives and changed when we restart numbering;
+	 * numbered frames and acknowledgements carry the receiver's session, so
+	 * those meant for an earlier one are ignored
+	 */
+	std::uint8_t arq_session;
+	std::optional<std::uint8_t> peer_arq_session;
+	/* Frames received since we last acknowledged, and whether to acknowledge without waiting */
+	unsigned arq_unacked{0};
+	bool arq_ack_now{false};
+	bool arq_ack_armed{false};
+	/* Window is full, counted once until it opens */
+	bool arq_stalled{false};
+
+	/* Advertised in keep-alives so both ends can check they agree */
+	std::uint16_t link_options;
+	std::optional<std::uint16_t> peer_link_options;
+	/* Frame boundaries (runs of our delimiter, pairs of the other framing's) seen since the last good frame */
+	struct {
+		std::size_t own;
+		std::size_t other;
+		/* Our delimiter alone, and the length of the current run of it */
+		std::size_t own_lone;
+		std::size_t own_run;
+		std::size_t bytes;
+		bool good_frame;
+		bool reported;
+	} rx_boundaries{};
+	std::uint8_t rx_last_byte{0};
+
+	static Encoder make_encoder(const Config& config);
+	static Decoder make_decoder(const Config& config);
+	static FrameCheck make_frame_check(const Config& config);
+	static Codel make_codel(const Config& config);
+	static std::vector<std::uint8_t> load_dictionary(const Config& config);
+
+	/* Writes and encodes packet, numbering it if sent reliably */
 	void write_packet(std::uint8_t frame_type, const void *data, size_t size);
-	/* Reads raw packet into "buffer", returns frame type and payload range */
+	/* Encodes frame into the UART queue, false if there is no room */
+	bool encode_frame(std::uint8_t frame_type, const void *data, size_t size);
+	/* Builds frame with check and FEC parity in fec_tx_buf, returns its size */
+	std::size_t fec_encode_frame(std::uint8_t frame_type, const void *data, size_t size);
+	/* Corrects decoded frame in place and strips its parity */
+	void fec_correct_frame(std::uint8_t *frame, std::size_t& size);
+	/* Whether frames are compressed against history shared with the peer */
+	bool tx_stream_compression() const;
+	/* Replaces frame with an LZ-compressed one, if enabled and worthwhile */
+	void compress_frame(std::uint8_t& frame_type, const void *& data, size_t& size);
+	/* Replaces LZ-compressed frame with its contents, false (and logged) if corrupt */
+	bool decompress_frame(std::uint8_t& frame_type, void *& data, size_t& size);
+	/* As decompress_frame, for stream frames, false if corrupt or out of step */
+	bool decompress_stream_frame(std::uint8_t& frame_type, void *& data, size_t& size);
+	/* Asks the peer to restart its stream compression history */
+	void request_stream_reset();
+	/* Restarts our stream compression history, the peer follows when it sees sequence zero */
+	void reset_tx_stream();
+	/* Adds packet to the aggregate frame, or writes it alone if the peer cannot take aggregates */
+	void aggregate_packet(std::uint8_t frame_type, const void *data, size_t size);
+	/* Writes pending aggregate (as a plain frame if it holds one packet) */
+	void flush_aggregate();
+	/* Whether packets larger than a fragment are split: enabled here and supported by the peer */
+	bool fragmenting() const;
+	/* Takes frame to be written as fragments by write_fragment */
+	void fragment_packet(std::uint8_t frame_type, const void *data, size_t size);
+	/* Writes next fragment of the pending frame */
+	void write_fragment();
+	/* Whether frames are numbered and retransmitted: enabled here and supported by the peer */
+	bool arq_active() const;
+	/* Whether new frames of a transmit class must wait for acknowledgements */
+	bool arq_window_closed(int tx_class) const;
+	/* Numbers frame and sends it, keeping it for retransmission */
+	void arq_send(std::uint8_t frame_type, const void *data, size_t size);
+	/* Sends (or resends) numbered frame, with our latest acknowledgement */
+	void arq_transmit(std::uint8_t seq);
+	/* Writes our acknowledgement to out (Arq::max_ack bytes), returns its size */
+	std::size_t arq_store_ack(std::uint8_t *out);
+	void arq_send_ack();
+	/* Handles ARQ frames and acknowledgements as they are decoded, true if consumed */
+	bool arq_handle_frame(const std::uint8_t *frame, std::size_t size);
+	/* Handles numbered frame (after its type), false if malformed */
+	bool arq_receive(const std::uint8_t *data, std::size_t size);
+	/* Frees acknowledged frames and retransmits those shown to be lost */
+	void arq_acknowledge(const Arq::Ack& ack);
+	/* Moves frames which are now in order into the receive queue, returns how many */
+	std::size_t arq_release();
+	/* Acknowledges shortly, unless a frame going out carries it first */
+	void arq_schedule_ack();
+	void arq_update_timer();
+	/* Restarts numbering in both directions, as the peer has */
+	void arq_restart();
+	/* Restarts numbering in a new session, which the peer follows */
+	void arq_reset();
+	/* Queues packet in given transmit class, to be encoded by pump_tx */
+	void queue_packet(TxClass tx_class, std::uint32_t flow, std::uint8_t frame_type, PacketPool::Buffer&& data);
+	/* Moves packets from transmit classes into the UART queue while it is shallow, call after queueing */
+	void pump_tx();
+	TxClass classify(const void *frame, size_t size, std::uint32_t& flow) const;
+	/* Converts queued IP packet to the wire format the peer supports, compressing its header if asked */
+	void adapt_ip_frame(TxQueue::Packet& packet, bool compress);
+	/* Replaces header of queued bare IP packet with a compressed one, if possible */
+	void compress_header(TxQueue::Packet& packet);
+	/* Marks queued IP packet as congestion experienced, false if not ECN-capable */
+	bool mark_congestion(TxQueue::Packet& packet);
+	/* Checks length and checksum of decoded frame, logs failures */
+	bool verify_frame(const std::uint8_t *frame, std::size_t size);
+	/*
+	 * Takes packet from receive queue, returns frame type and payload range
+	 * (valid until the receive queue is next written to)
+	 */
 	std::tuple<std::uint8_t, void *, size_t> read_packet();
 
 	void verbose_hexdump(const char *title, const void *buf, size_t len);
@@ -66,6 +286,7 @@ class IpLink
 	void peer_state_changed(bool value);
 
 	void update_timer(Linux::TimerFD& timer, unsigned delay);
+	void update_timer_us(Linux::TimerFD& timer, std::uint64_t delay);
 	void reset_send_ka_timer();
 	void reset_recv_ka_timer();
 
@@ -73,22 +294,65 @@ class IpLink
 	void rebind_serial_events();
 	void rebind_tun_events();
 
+	/* Event loop ids of our descriptors */
+	enum Slot {
+		slot_signal,
+		slot_meter,
+		slot_send_ka,
+		slot_recv_ka,
+		slot_tx_pace,
+		slot_tx_linger,
+		slot_rx_reassembly,
+		slot_arq_rto,
+		slot_arq_ack,
+		slot_serial,
+		slot_tun
+	};
+	void on_event(std::uint64_t slot, Events events);
+
 	void on_signal(Events events);
 	void on_update_meter(Events events);
 	void on_send_ka_timer(Events events);
 	void on_recv_ka_timer(Events events);
+	void on_tx_pace_timer(Events events);
+	void on_tx_linger_timer(Events events);
+	void on_rx_reassembly_timer(Events events);
+	void on_arq_rto_timer(Events events);
+	void on_arq_ack_timer(Events events);
 	void on_serial(Events events);
 	void on_tun(Events events);
 
-	void on_serial_readable();
-	void on_serial_writable();
-	void on_tun_readable();
+	/* These return true once the descriptor has run dry (or its buffer is full) */
+	bool on_serial_readable();
+	bool on_serial_writable();
+	bool on_tun_readable();
 	void on_tun_writable();
 
+	bool serial_read_allowed() const;
+	bool serial_write_allowed() const;
+	/* Edge-triggered mode: whether any ready descriptor has work to do */
+	bool has_ready_work() const;
+	void service_ready();
+	/* Writes next packet from receive queue to TUN (or handles it, if a control frame) */
+	void deliver_packet();
+	/* Handles one (decompressed) frame, which may have arrived inside an aggregate */
+	void deliver_frame(std::uint8_t frame_type, void *data, size_t size);
+	/* Handles each frame packed in an aggregate */
+	void deliver_aggregate(void *data, size_t size);
+	/* Adds fragment to the frame being reassembled, handles the frame once complete */
+	void deliver_fragment(void *data, size_t size);
+	/* Drops the partly reassembled frame, if any */
+	void drop_reassembly();
+	/* Writes bare IP packet, given as header and payload, to TUN */
+	void send_to_tun(const void *header, size_t header_size, const void *payload, size_t payload_size);
+
 	void send_keepalive();
 	void on_sent_keepalive();
 	void on_received_keepalive();
 	void on_missed_keepalive();
+	void check_link_options(const void *data, size_t size);
+	/* Reports a peer whose framing differs, which no option exchange can reach */
+	void check_framing(const std::uint8_t *data, size_t size);
 
 public:
 	IpLink(const Config& config);
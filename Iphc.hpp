@@ -0,0 +1,371 @@
+#pragma once
+
+/*
+ * Context-based UDP/IP header compression for IPv4 and IPv6, in the spirit
+ * of 6LoWPAN IPHC (RFC 6282) and ROHC profile 2 (RFC 3095).
+ *
+ * Each flow is assigned a slot.  A "full" packet is the original packet
+ * tagged with its slot, and sets the slot's context on both sides.  Later
+ * packets in the flow carry only the slot, a check byte identifying the
+ * context, and the IPv4 ID when it does not simply count up.  Addresses,
+ * ports, traffic class, TTL and flow label come from the context, lengths
+ * from the frame size, and the IPv4 and UDP checksums are recomputed.  The
+ * compressor only elides a UDP checksum after verifying it, so corruption
+ * upstream of the link is never hidden.
+ *
+ * Unlike TCP, nothing retransmits a lost full packet, so each slot's full
+ * header is resent every refresh_interval packets.  Until then, packets
+ * whose check byte does not match the receiver's context are dropped rather
+ * than misdelivered.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "IpHeader.hpp"
+
+namespace Iphc {
+
+/* Slot is carried in the top nibble of the first byte */
+static constexpr std::size_t max_slots = 16;
+
+/* Full header is resent after this many compressed packets in a slot */
+static constexpr unsigned refresh_interval = 32;
+
+/* Largest IP + UDP header kept per slot */
+static constexpr std::size_t max_header = 60 + 8;
+
+/* Largest compressed header: slot and flags, check, IPv4 ID */
+static constexpr std::size_t max_compressed = 4;
+
+/* IPv4 ID coding, in the low bits of the first byte */
+static constexpr std::uint8_t id_next = 0x00;
+static constexpr std::uint8_t id_same = 0x01;
+static constexpr std::uint8_t id_explicit = 0x02;
+static constexpr std::uint8_t id_mask = 0x03;
+/* IPv4 UDP datagram was sent without checksum */
+static constexpr std::uint8_t no_checksum = 0x04;
+
+enum Type {
+	/* Not compressible, send as-is */
+	type_ip,
+	/* Send as-is, tagged with slot, to (re)establish the slot */
+	type_full,
+	/* Send compressed header followed by payload */
+	type_compressed
+};
+
+namespace detail {
+
+struct Slot
+{
+	std::uint8_t header[max_header];
+	std::size_t header_size{0};
+	/* Hash of the context, sent with compressed packets */
+	std::uint8_t check{0};
+	/* Compressed packets since the last full one */
+	unsigned age{0};
+};
+
+/* Size of IP and UDP headers of an unfragmented UDP packet, zero if not one */
+inline std::size_t header_size(const std::uint8_t *packet, std::size_t size)
+{
+	using namespace IpHeader;
+	if (size < 1) {
+		return 0;
+	}
+	std::size_t ip_size;
+	if (packet[0] >> 4 == 4) {
+		ip_size = (packet[0] & 0x0f) * 4;
+		if (size < 28 || ip_size < 20 || size < ip_size + 8 ||
+				packet[9] != proto_udp ||
+				(load16(packet + 6) & 0x3fff) ||
+				load16(packet + 2) != size) {
+			return 0;
+		}
+	} else if (packet[0] >> 4 == 6) {
+		ip_size = 40;
+		if (size < 48 || packet[6] != proto_udp || load16(packet + 4) != size - 40) {
+			return 0;
+		}
+	} else {
+		return 0;
+	}
+	if (load16(packet + ip_size + 4) != size - ip_size) {
+		return 0;
+	}
+	return ip_size + 8;
+}
+
+/*
+ * Calls f(data, size) for each range of header bytes which identify a flow's
+ * context: everything except lengths, checksums and the IPv4 ID
+ */
+template <typename F>
+void for_each_static(const std::uint8_t *header, std::size_t header_size, F&& f)
+{
+	const std::size_t ip_size = header_size - 8;
+	if (header[0] >> 4 == 4) {
+		f(header, 2);
+		f(header + 6, 4);
+		f(header + 12, ip_size - 12);
+	} else {
+		f(header, 4);
+		f(header + 6, ip_size - 6);
+	}
+	f(header + ip_size, 4);
+}
+
+inline bool same_context(const std::uint8_t *a, const std::uint8_t *b, std::size_t header_size)
+{
+	bool same = true;
+	for_each_static(a, header_size, [&] (const std::uint8_t *p, std::size_t size) {
+		same = same && std::memcmp(p, b + (p - a), size) == 0;
+	});
+	return same;
+}
+
+inline std::uint8_t context_check(const std::uint8_t *header, std::size_t header_size)
+{
+	/* FNV-1a, folded */
+	std::uint32_t hash = 2166136261u;
+	for_each_static(header, header_size, [&] (const std::uint8_t *p, std::size_t size) {
+		for (std::size_t i = 0; i < size; i++) {
+			hash = (hash ^ p[i]) * 16777619u;
+		}
+	});
+	return hash ^ hash >> 8 ^ hash >> 16 ^ hash >> 24;
+}
+
+inline std::uint32_t sum16(std::uint32_t sum, const std::uint8_t *p, std::size_t size)
+{
+	for (std::size_t i = 0; i + 1 < size; i += 2) {
+		sum += IpHeader::load16(p + i);
+	}
+	if (size & 1) {
+		sum += std::uint32_t(p[size - 1]) << 8;
+	}
+	return sum;
+}
+
+/* UDP checksum of header (with any checksum field) and separate payload */
+inline std::uint16_t udp_checksum(const std::uint8_t *header, std::size_t header_size, const std::uint8_t *payload, std::size_t payload_size)
+{
+	const std::size_t ip_size = header_size - 8;
+	const std::uint8_t *udp = header + ip_size;
+	std::uint32_t sum = IpHeader::proto_udp + header_size - ip_size + payload_size;
+	/* Pseudo-header addresses */
+	if (header[0] >> 4 == 4) {
+		sum = sum16(sum, header + 12, 8);
+	} else {
+		sum = sum16(sum, header + 8, 32);
+	}
+	sum = sum16(sum, udp, 6);
+	sum = sum16(sum, payload, payload_size);
+	while (sum >> 16) {
+		sum = (sum & 0xffff) + (sum >> 16);
+	}
+	const std::uint16_t checksum = ~sum;
+	return checksum == 0 ? 0xffff : checksum;
+}
+
+}
+
+class Compressor
+{
+	std::vector<detail::Slot> slots;
+	/* Slot indices, most recently used first */
+	std::vector<std::uint8_t> lru;
+
+	/* Finds slot of packet's flow, or recycles the least recently used */
+	bool lookup(const std::uint8_t *packet, std::size_t header_size, std::size_t& index)
+	{
+		for (std::size_t i = 0; i < lru.size(); i++) {
+			const auto& slot = slots[lru[i]];
+			if (slot.header_size == header_size && detail::same_context(slot.header, packet, header_size)) {
+				index = lru[i];
+				std::memmove(&lru[1], &lru[0], i);
+				lru[0] = index;
+				return true;
+			}
+		}
+		index = lru.back();
+		std::memmove(&lru[1], &lru[0], lru.size() - 1);
+		lru[0] = index;
+		return false;
+	}
+
+public:
+	explicit Compressor(std::size_t slot_count) :
+		slots(slot_count),
+		lru(slot_count)
+	{
+		reset();
+	}
+
+	void reset()
+	{
+		for (std::size_t i = 0; i < slots.size(); i++) {
+			slots[i].header_size = 0;
+			lru[i] = i;
+		}
+	}
+
+	/*
+	 * Decides how to send packet.  For type_compressed, the first
+	 * header_size bytes of the packet are to be replaced with the out_size
+	 * bytes written to out (max_compressed).  For type_full, slot is the
+	 * slot to tag the packet with.
+	 */
+	Type compress(const std::uint8_t *packet, std::size_t size, std::uint8_t *out, std::size_t& out_size, std::size_t& header_size, std::uint8_t& slot_id)
+	{
+		using namespace IpHeader;
+		header_size = detail::header_size(packet, size);
+		if (header_size == 0) {
+			return type_ip;
+		}
+		const bool v4 = packet[0] >> 4 == 4;
+		const std::uint16_t checksum = load16(packet + header_size - 2);
+		if (checksum == 0 ? !v4 :
+				checksum != detail::udp_checksum(packet, header_size, packet + header_size, size - header_size)) {
+			return type_ip;
+		}
+
+		std::size_t index;
+		const bool found = lookup(packet, header_size, index);
+		auto& slot = slots[index];
+		slot_id = index;
+		const std::uint16_t last_id = load16(slot.header + 4);
+		std::memcpy(slot.header, packet, header_size);
+		if (!found || slot.age >= refresh_interval) {
+			slot.header_size = header_size;
+			slot.check = detail::context_check(packet, header_size);
+			slot.age = 0;
+			return type_full;
+		}
+		slot.age++;
+
+		std::uint8_t *o = out;
+		std::uint8_t flags = checksum == 0 ? no_checksum : 0;
+		std::uint16_t id = 0;
+		if (v4) {
+			id = load16(packet + 4);
+			/* A lost packet makes a counted ID wrong, which only matters if it may be fragmented */
+			const bool dont_fragment = load16(packet + 6) & 0x4000;
+			if (dont_fragment && id == std::uint16_t(last_id + 1)) {
+				flags |= id_next;
+			} else if (dont_fragment && id == last_id) {
+				flags |= id_same;
+			} else {
+				flags |= id_explicit;
+			}
+		}
+		*o++ = slot_id << 4 | flags;
+		*o++ = slot.check;
+		if ((flags & id_mask) == id_explicit) {
+			store16(o, id);
+			o += 2;
+		}
+		out_size = o - out;
+		return type_compressed;
+	}
+};
+
+class Decompressor
+{
+	std::vector<detail::Slot> slots;
+
+public:
+	explicit Decompressor(std::size_t slot_count) :
+		slots(slot_count)
+	{
+	}
+
+	void reset()
+	{
+		for (auto& slot : slots) {
+			slot.header_size = 0;
+		}
+	}
+
+	/* Records header of a full packet, returns false if unusable */
+	bool remember(std::uint8_t slot_id, const std::uint8_t *packet, std::size_t size)
+	{
+		const auto header_size = detail::header_size(packet, size);
+		if (slot_id >= slots.size() || header_size == 0) {
+			return false;
+		}
+		auto& slot = slots[slot_id];
+		std::memcpy(slot.header, packet, header_size);
+		slot.header_size = header_size;
+		slot.check = detail::context_check(packet, header_size);
+		return true;
+	}
+
+	/*
+	 * Rebuilds header of a compressed packet into header (max_header bytes),
+	 * returns its size, or zero if the packet must be dropped.  consumed is
+	 * set to the size of the compressed header, the payload follows it.
+	 */
+	std::size_t decompress(const std::uint8_t *in, std::size_t size, std::uint8_t *header, std::size_t& consumed)
+	{
+		using namespace IpHeader;
+		if (size < 2) {
+			return 0;
+		}
+		const std::size_t slot_id = in[0] >> 4;
+		const std::uint8_t flags = in[0] & 0x0f;
+		if (slot_id >= slots.size()) {
+			return 0;
+		}
+		auto& slot = slots[slot_id];
+		if (slot.header_size == 0 || slot.check != in[1]) {
+			return 0;
+		}
+		const std::uint8_t *p = in + 2;
+		std::uint8_t *ip = slot.header;
+		const bool v4 = ip[0] >> 4 == 4;
+		if (v4) {
+			switch (flags & id_mask) {
+			case id_next:
+				store16(ip + 4, load16(ip + 4) + 1);
+				break;
+			case id_same:
+				break;
+			case id_explicit:
+				if (size < 4) {
+					return 0;
+				}
+				store16(ip + 4, load16(p));
+				p += 2;
+				break;
+			default:
+				return 0;
+			}
+		}
+		consumed = p - in;
+
+		const std::size_t header_size = slot.header_size;
+		const std::size_t payload_size = size - consumed;
+		const std::size_t ip_size = header_size - 8;
+		std::uint8_t *udp = ip + ip_size;
+		if (v4) {
+			store16(ip + 2, header_size + payload_size);
+			store16(ip + 10, 0);
+			store16(ip + 10, ipv4_checksum(ip, ip_size));
+		} else {
+			store16(ip + 4, 8 + payload_size);
+		}
+		store16(udp + 4, 8 + payload_size);
+		store16(udp + 6, 0);
+		if (!(flags & no_checksum)) {
+			store16(udp + 6, detail::udp_checksum(ip, header_size, p, payload_size));
+		}
+		std::memcpy(header, ip, header_size);
+		return header_size;
+	}
+};
+
+}
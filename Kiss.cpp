@@ -0,0 +1,186 @@
+#include <cstring>
+
+#if defined __x86_64__ || defined __i386__
+#include <immintrin.h>
+#define KISS_X86
+#endif
+
+#include "Kiss.hpp"
+
+namespace Kiss {
+
+namespace detail {
+
+/*
+ * Portable fallback: SWAR over 64-bit words.  zero_bytes() sets the top bit
+ * of exactly those bytes of x which are zero.
+ */
+
+static constexpr std::uint64_t ones = 0x0101010101010101ULL;
+static constexpr std::uint64_t low7 = 0x7f7f7f7f7f7f7f7fULL;
+
+static inline std::uint64_t zero_bytes(std::uint64_t x)
+{
+	return ~(((x & low7) + low7) | x | low7);
+}
+
+static inline std::uint64_t special_bytes(const std::uint8_t *p)
+{
+	std::uint64_t x;
+	std::memcpy(&x, p, sizeof(x));
+	return zero_bytes(x ^ (ones * Config::FEND)) | zero_bytes(x ^ (ones * Config::FESC));
+}
+
+static inline bool is_special(std::uint8_t byte)
+{
+	return byte == Config::FEND || byte == Config::FESC;
+}
+
+static std::size_t find_special_scalar(const std::uint8_t *buf, std::size_t len)
+{
+	std::size_t i = 0;
+	for (; i + 8 <= len; i += 8) {
+		const auto mask = special_bytes(buf + i);
+		if (mask) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+			return i + __builtin_ctzll(mask) / 8;
+#else
+			return i + __builtin_clzll(mask) / 8;
+#endif
+		}
+	}
+	for (; i < len; i++) {
+		if (is_special(buf[i])) {
+			break;
+		}
+	}
+	return i;
+}
+
+static std::size_t count_special_scalar(const std::uint8_t *buf, std::size_t len)
+{
+	std::size_t count = 0;
+	std::size_t i = 0;
+	for (; i + 8 <= len; i += 8) {
+		count += __builtin_popcountll(special_bytes(buf + i));
+	}
+	for (; i < len; i++) {
+		count += is_special(buf[i]);
+	}
+	return count;
+}
+
+#if defined KISS_X86
+
+__attribute__((target("sse2")))
+static inline unsigned special_mask_sse2(const std::uint8_t *p)
+{
+	const __m128i fend = _mm_set1_epi8(char(Config::FEND));
+	const __m128i fesc = _mm_set1_epi8(char(Config::FESC));
+	const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+	return _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, fend), _mm_cmpeq_epi8(v, fesc)));
+}
+
+__attribute__((target("sse2")))
+static std::size_t find_special_sse2(const std::uint8_t *buf, std::size_t len)
+{
+	std::size_t i = 0;
+	for (; i + 16 <= len; i += 16) {
+		const auto mask = special_mask_sse2(buf + i);
+		if (mask) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+	return i + find_special_scalar(buf + i, len - i);
+}
+
+__attribute__((target("sse2")))
+static std::size_t count_special_sse2(const std::uint8_t *buf, std::size_t len)
+{
+	std::size_t count = 0;
+	std::size_t i = 0;
+	for (; i + 16 <= len; i += 16) {
+		count += __builtin_popcount(special_mask_sse2(buf + i));
+	}
+	return count + count_special_scalar(buf + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static inline unsigned special_mask_avx2(const std::uint8_t *p)
+{
+	const __m256i fend = _mm256_set1_epi8(char(Config::FEND));
+	const __m256i fesc = _mm256_set1_epi8(char(Config::FESC));
+	const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+	return _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, fend), _mm256_cmpeq_epi8(v, fesc)));
+}
+
+__attribute__((target("avx2")))
+static std::size_t find_special_avx2(const std::uint8_t *buf, std::size_t len)
+{
+	std::size_t i = 0;
+	for (; i + 32 <= len; i += 32) {
+		const auto mask = special_mask_avx2(buf + i);
+		if (mask) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+	return i + find_special_sse2(buf + i, len - i);
+}
+
+__attribute__((target("avx2,popcnt")))
+static std::size_t count_special_avx2(const std::uint8_t *buf, std::size_t len)
+{
+	std::size_t count = 0;
+	std::size_t i = 0;
+	for (; i + 32 <= len; i += 32) {
+		count += __builtin_popcount(special_mask_avx2(buf + i));
+	}
+	return count + count_special_sse2(buf + i, len - i);
+}
+
+using Scanner = std::size_t (*)(const std::uint8_t *buf, std::size_t len);
+
+/* Pick the widest implementation supported by this CPU */
+static Scanner select(Scanner scalar, Scanner sse2, Scanner avx2)
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return avx2;
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		return sse2;
+	}
+	return scalar;
+}
+
+static const Scanner find_special_impl = select(find_special_scalar, find_special_sse2, find_special_avx2);
+static const Scanner count_special_impl = select(count_special_scalar, count_special_sse2, count_special_avx2);
+
+std::size_t find_special(const std::uint8_t *buf, std::size_t len)
+{
+	return find_special_impl(buf, len);
+}
+
+std::size_t count_special(const std::uint8_t *buf, std::size_t len)
+{
+	return count_special_impl(buf, len);
+}
+
+#else
+
+std::size_t find_special(const std::uint8_t *buf, std::size_t len)
+{
+	return find_special_scalar(buf, len);
+}
+
+std::size_t count_special(const std::uint8_t *buf, std::size_t len)
+{
+	return count_special_scalar(buf, len);
+}
+
+#endif
+
+}
+
+}
+
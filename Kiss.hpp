@@ -7,6 +7,8 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <algorithm>
 #include <vector>
 #include <list>
 #include <optional>
@@ -23,9 +25,47 @@ struct Config
 	static constexpr std::uint8_t TFESC = 0xdd;
 };
 
+namespace detail {
+
+/*
+ * Vectorised scanners (SSE2/AVX2 chosen at runtime, portable fallback
+ * otherwise), see Kiss.cpp
+ */
+
+/* Offset of first FEND/FESC in buffer, or len if there is none */
+std::size_t find_special(const std::uint8_t *buf, std::size_t len);
+
+/* Number of FEND/FESC bytes in buffer */
+std::size_t count_special(const std::uint8_t *buf, std::size_t len);
+
+}
+
 class Encoder
 {
+	static constexpr std::size_t fused_chunk = 512;
+
 public:
+	/* Exact size of buffer once escaped (excluding FENDs) */
+	static std::size_t encoded_length(const void *buf, std::size_t len)
+	{
+		return len + detail::count_special(static_cast<const std::uint8_t *>(buf), len);
+	}
+
+	/* Worst-case size of a frame holding len bytes (including FENDs) */
+	static constexpr std::size_t max_frame_length(std::size_t len)
+	{
+		return 2 * len + 2;
+	}
+
+	/*
+	 * Size of a frame holding the lead byte and buffer, escaped exactly, then
+	 * tail_len bytes not known yet and sized at worst case (including FENDs)
+	 */
+	static std::size_t frame_length(std::uint8_t lead, const void *buf, std::size_t len, std::size_t tail_len)
+	{
+		return encoded_length(&lead, 1) + encoded_length(buf, len) + 2 * tail_len + 2;
+	}
+
 	template <typename OutputIt>
 	OutputIt open(OutputIt oit)
 	{
@@ -64,12 +104,65 @@ public:
 		const char *p = static_cast<const char *>(buf);
 		return write(p, p + len, oit);
 	}
+
+	/*
+	 * Contiguous fast path: clean runs between special bytes are found by
+	 * the vectorised scanner and copied in bulk.  Output must have room for
+	 * encoded_length(buf, len) bytes.
+	 */
+	std::uint8_t *write(const void *buf, std::size_t len, std::uint8_t *out)
+	{
+		const std::uint8_t *p = static_cast<const std::uint8_t *>(buf);
+		const std::uint8_t *end = p + len;
+		while (p != end) {
+			const auto run = detail::find_special(p, end - p);
+			std::memcpy(out, p, run);
+			out += run;
+			p += run;
+			if (p == end) {
+				break;
+			}
+			*out++ = Config::FESC;
+			*out++ = *p++ == Config::FEND ? Config::TFEND : Config::TFESC;
+		}
+		return out;
+	}
+
+	/*
+	 * Fused pass: observer(data, size) sees each chunk of input just before
+	 * it is encoded, while it is still hot in cache
+	 */
+	template <typename OutputIt, typename Observer>
+	OutputIt write(const void *buf, std::size_t len, OutputIt oit, Observer&& observer)
+	{
+		const std::uint8_t *p = static_cast<const std::uint8_t *>(buf);
+		while (len > 0) {
+			const auto chunk = std::min<std::size_t>(len, fused_chunk);
+			observer(p, chunk);
+			oit = write(p, chunk, oit);
+			p += chunk;
+			len -= chunk;
+		}
+		return oit;
+	}
+};
+
+/* Decoder observer which ignores everything */
+struct NullObserver
+{
+	void start()
+	{
+	}
+	void update(const std::uint8_t *, std::size_t)
+	{
+	}
 };
 
 class Decoder
 {
 	std::size_t max_packet_length;
 
+	/* Reserved once, reused for every frame */
 	std::vector<std::uint8_t> packet;
 
 	enum State {
@@ -80,75 +173,156 @@ class Decoder
 	};
 	State state = idle;
 
-	template <typename InputIt>
-	std::list<std::vector<std::uint8_t>> decode_internal(InputIt begin, InputIt end)
+	/*
+	 * Sink is called as sink(const std::uint8_t *data, std::size_t size) for
+	 * each complete packet, the range is only valid for the duration of the
+	 * call
+	 */
+	template <typename Sink, typename Observer>
+	void step(const std::uint8_t in, Sink& sink, Observer& observer)
 	{
-		std::list<std::vector<std::uint8_t>> packets;
-		for (InputIt& it = begin; it != end; ++it) {
-			const std::uint8_t in = *it;
-			std::uint8_t out = 0; // init here to keep gcc happy
-			/* Can we go from error state to idle */
-			if (state == error) {
-				if (in == Config::FEND) {
-					state = idle;
-				}
+		std::uint8_t out = 0; // init here to keep gcc happy
+		/* Can we go from error state to idle */
+		if (state == error) {
+			if (in == Config::FEND) {
+				state = idle;
 			}
-			/* Can we go from idle state to active? */
-			if (state == idle) {
-				if (in != Config::FEND) {
-					state = active;
-					packet = {};
-				}
+		}
+		/* Can we go from idle state to active? */
+		if (state == idle) {
+			if (in != Config::FEND) {
+				state = active;
+				packet.clear();
+				observer.start();
 			}
-			/* Process packet contents/terminator */
-			if (state == active) {
-				if (in == Config::FESC) {
-					/* Escape sequence */
-					state = active_escape;
-				} else if (in == Config::FEND) {
-					/* End of packet */
-					state = idle;
-					packets.emplace_back(std::move(packet));
-				} else {
-					/* Verbatim */
-					out = in;
-				}
-			} else if (state == active_escape) {
-				/* Handle escape sequences (emit byte, return to normal mode) */
-				if (in == Config::TFEND) {
-					state = active;
-					out = Config::FEND;
-				} else if (in == Config::TFESC) {
-					state = active;
-					out = Config::FESC;
-				} else {
-					/* Invalid escape sequence: transition to error state */
-					state = error;
-				}
+		}
+		/* Process packet contents/terminator */
+		if (state == active) {
+			if (in == Config::FESC) {
+				/* Escape sequence */
+				state = active_escape;
+			} else if (in == Config::FEND) {
+				/* End of packet */
+				state = idle;
+				sink(static_cast<const std::uint8_t *>(packet.data()), packet.size());
+			} else {
+				/* Verbatim */
+				out = in;
 			}
-			/* If we're in active state, emit a byte (unless buffer overflows) */
-			if (state == active) {
-				if (packet.size() == max_packet_length) {
-					state = error;
-				} else {
-					packet.push_back(out);
+		} else if (state == active_escape) {
+			/* Handle escape sequences (emit byte, return to normal mode) */
+			if (in == Config::TFEND) {
+				state = active;
+				out = Config::FEND;
+			} else if (in == Config::TFESC) {
+				state = active;
+				out = Config::FESC;
+			} else {
+				/* Invalid escape sequence: transition to error state */
+				state = error;
+			}
+		}
+		/* If we're in active state, emit a byte (unless buffer overflows) */
+		if (state == active) {
+			if (packet.size() == max_packet_length) {
+				state = error;
+			} else {
+				packet.push_back(out);
+				observer.update(static_cast<const std::uint8_t *>(packet.data()), packet.size());
+			}
+		}
+	}
+
+	/* Byte-at-a-time state machine, for arbitrary iterators */
+	template <typename InputIt, typename Sink, typename Observer>
+	void decode_internal(InputIt begin, InputIt end, Sink& sink, Observer& observer)
+	{
+		for (InputIt& it = begin; it != end; ++it) {
+			step(*it, sink, observer);
+		}
+	}
+
+	/*
+	 * Contiguous fast path: verbatim runs are located with the vectorised
+	 * scanner and copied in bulk, the state machine only sees escapes and
+	 * frame boundaries
+	 */
+	template <typename Sink, typename Observer>
+	void decode_contiguous(const std::uint8_t *p, const std::uint8_t *end, Sink& sink, Observer& observer)
+	{
+		while (p != end) {
+			if (state == active && *p == Config::FESC && end - p >= 2 &&
+					(p[1] == Config::TFEND || p[1] == Config::TFESC) &&
+					packet.size() < max_packet_length) {
+				/* Complete escape sequence */
+				packet.push_back(p[1] == Config::TFEND ? Config::FEND : Config::FESC);
+				observer.update(static_cast<const std::uint8_t *>(packet.data()), packet.size());
+				p += 2;
+				continue;
+			} else if (state == active && *p != Config::FEND && *p != Config::FESC) {
+				const auto limit = std::min<std::size_t>(end - p, max_packet_length - packet.size());
+				const auto run = detail::find_special(p, limit);
+				packet.insert(packet.end(), p, p + run);
+				observer.update(static_cast<const std::uint8_t *>(packet.data()), packet.size());
+				p += run;
+				if (p == end) {
+					break;
 				}
+			} else if (state == error) {
+				/* Skip to the next frame boundary */
+				const void *fend = std::memchr(p, Config::FEND, end - p);
+				if (fend == nullptr) {
+					break;
+				}
+				p = static_cast<const std::uint8_t *>(fend);
 			}
+			step(*p++, sink, observer);
 		}
-		return packets;
 	}
 
 public:
 	Decoder(std::size_t max_packet_length) :
-		max_packet_length(max_packet_length),
-		packet(max_packet_length)
+		max_packet_length(max_packet_length)
+	{
+		packet.reserve(max_packet_length);
+	}
+
+	/*
+	 * Streaming decode, no allocation: each packet is passed to sink.
+	 *
+	 * Observer (optional) sees the packet as it is built: observer.start()
+	 * at the beginning of each frame and observer.update(data, size) with
+	 * the whole packet so far each time bytes are added to it.
+	 */
+	template <typename InputIt, typename Sink, typename Observer>
+	void decode(InputIt begin, InputIt end, Sink&& sink, Observer& observer)
 	{
+		decode_internal(begin, end, sink, observer);
+	}
+
+	template <typename Sink, typename Observer>
+	void decode(const std::uint8_t *begin, const std::uint8_t *end, Sink&& sink, Observer& observer)
+	{
+		decode_contiguous(begin, end, sink, observer);
+	}
+
+	template <typename InputIt, typename Sink>
+	void decode(InputIt begin, InputIt end, Sink&& sink)
+	{
+		NullObserver observer;
+		decode(begin, end, sink, observer);
 	}
 
 	template <typename InputIt>
 	std::list<std::vector<std::uint8_t>> decode(InputIt begin, InputIt end)
 	{
-		return decode_internal(begin, end);
+		std::list<std::vector<std::uint8_t>> packets;
+		auto sink = [&packets] (const std::uint8_t *data, std::size_t size) {
+			packets.emplace_back(data, data + size);
+		};
+		NullObserver observer;
+		decode_internal(begin, end, sink, observer);
+		return packets;
 	}
 
 	template <typename Container>
@@ -6,6 +6,8 @@
 #include <utility>
 #include <optional>
 #include <map>
+#include <deque>
+#include <vector>
 
 #include <cstdint>
 #include <cstring>
@@ -796,6 +798,12 @@ struct TimerFD :
 		detail::assert_zero("timerfd_settime", timerfd_settime(get_fd(), 0, &ts, NULL));
 	}
 
+	void disarm()
+	{
+		itimerspec ts = {};
+		detail::assert_zero("timerfd_settime", timerfd_settime(get_fd(), 0, &ts, NULL));
+	}
+
 	std::uint64_t read_tick_count()
 	{
 		std::uint64_t count;
@@ -828,7 +836,63 @@ struct EpollFD :
 	};
 	using Handler = std::function<void(Events)>;
 private:
-	std::map<int, Handler> handlers;
+	struct Binding
+	{
+		Handler handler;
+		/* Passed back in epoll_event.data */
+		std::uint64_t id;
+		/* Current interest mask and flags, to skip redundant rebinds */
+		std::uint32_t mask;
+	};
+	/*
+	 * Set in the id of fds bound with a handler, whose id is otherwise the fd;
+	 * ids chosen by callers of bind_id may not use it
+	 */
+	static constexpr std::uint64_t handler_id = std::uint64_t(1) << 63;
+	/* Indexed by fd, deque so handlers stay put if one binds another fd */
+	std::deque<Binding> bindings;
+	/* Reused by every wait */
+	std::vector<epoll_event> events;
+
+	void add(int fd, std::uint64_t id, std::uint32_t mask, Handler handler)
+	{
+		const auto size = bindings.size();
+		if (size <= std::size_t(fd)) {
+			bindings.resize(fd + 1);
+		}
+		epoll_event ee;
+		ee.events = mask;
+		ee.data.u64 = id;
+		try {
+			detail::assert_zero("epoll_ctl", epoll_ctl(get_fd(), EPOLL_CTL_ADD, fd, &ee));
+		} catch (SystemError& e) {
+			/* Undo any growth of the table, as nothing was bound */
+			bindings.resize(size);
+			throw;
+		}
+		/* Only recorded once added, an fd which is already bound keeps its binding */
+		auto& binding = bindings[fd];
+		binding.handler = std::move(handler);
+		binding.id = id;
+		binding.mask = mask;
+	}
+
+	/* Calls the handler an event's id leads to, the id must be from bind */
+	void handle(const epoll_event& event)
+	{
+		if (!(event.data.u64 & handler_id)) {
+			throw std::logic_error("EpollFD: event for an fd bound with bind_id, use dispatch");
+		}
+		bindings.at(event.data.u64 & ~handler_id).handler(Events(event.events));
+	}
+
+	int poll(int max_events, int timeout, const std::optional<SignalSet>& signal_mask)
+	{
+		if (events.size() < std::size_t(max_events)) {
+			events.resize(max_events);
+		}
+		return detail::assert_not_negative("epoll_wait", epoll_pwait(get_fd(), events.data(), max_events, timeout, signal_mask.has_value() ? &signal_mask->get_fd() : nullptr));
+	}
 public:
 	enum Trigger
 	{
@@ -856,38 +920,62 @@ public:
 	}
 	void bind(const FileDescriptor& fd, Handler handler, Events events, Trigger trigger = trigger_level, PowerOptions power_options = power_opt_none)
 	{
-		auto it = handlers.insert_or_assign(fd.get_fd(), std::move(handler));
-		epoll_event ee;
-		ee.events = int(events) | int(trigger) | int(power_options);
-		ee.data.fd = fd.get_fd();
-		try {
-			detail::assert_zero("epoll_ctl", epoll_ctl(get_fd(), EPOLL_CTL_ADD, fd.get_fd(), &ee));
-		} catch (SystemError& e) {
-			handlers.erase(it.first);
-			throw;
+		add(fd.get_fd(), handler_id | fd.get_fd(), int(events) | int(trigger) | int(power_options), std::move(handler));
+	}
+	/*
+	 * Binds fd to an id of the caller's choosing, which dispatch() passes to
+	 * the dispatcher instead of calling a handler (the top bit is reserved)
+	 */
+	void bind_id(const FileDescriptor& fd, std::uint64_t id, Events events, Trigger trigger = trigger_level, PowerOptions power_options = power_opt_none)
+	{
+		if (id & handler_id) {
+			throw std::invalid_argument("EpollFD: id has the reserved top bit set");
 		}
+		add(fd.get_fd(), id, int(events) | int(trigger) | int(power_options), nullptr);
 	}
 	void rebind(const FileDescriptor& fd, Events events, Trigger trigger = trigger_level, PowerOptions power_options = power_opt_none)
 	{
+		auto& binding = bindings.at(fd.get_fd());
+		const std::uint32_t mask = int(events) | int(trigger) | int(power_options);
+		if (mask == binding.mask) {
+			return;
+		}
 		epoll_event ee;
-		ee.events = int(events) | int(trigger) | int(power_options);
-		ee.data.fd = fd.get_fd();
+		ee.events = mask;
+		ee.data.u64 = binding.id;
 		detail::assert_zero("epoll_ctl", epoll_ctl(get_fd(), EPOLL_CTL_MOD, fd.get_fd(), &ee));
+		binding.mask = mask;
 	}
 	void unbind(const FileDescriptor& fd)
 	{
 		detail::assert_zero("epoll_ctl", epoll_ctl(get_fd(), EPOLL_CTL_DEL, fd.get_fd(), NULL));
-		handlers.erase(fd.get_fd());
+		bindings.at(fd.get_fd()) = {};
 	}
+	/* Waits for events and calls the handler of each (fds must be bound with bind) */
 	int wait(int max_events = 1, int timeout = -1, const std::optional<SignalSet>& signal_mask = std::nullopt)
 	{
-		std::vector<epoll_event> events;
-		events.resize(max_events);
-		auto count = detail::assert_not_negative("epoll_wait", epoll_pwait(get_fd(), events.data(), events.size(), timeout, signal_mask.has_value() ? &signal_mask->get_fd() : nullptr));
-		events.resize(count);
-		for (const auto& event : events) {
-			auto& handler = handlers.at(event.data.fd);
-			handler(Events(event.events));
+		const auto count = poll(max_events, timeout, signal_mask);
+		for (int i = 0; i < count; i++) {
+			handle(events[i]);
+		}
+		return count;
+	}
+	/*
+	 * Waits for events and calls dispatcher(id, events) for each fd bound
+	 * with bind_id, without allocating or type-erased calls (fds bound with
+	 * bind still have their handler called)
+	 */
+	template <typename Dispatcher>
+	int dispatch(Dispatcher&& dispatcher, int max_events = 1, int timeout = -1, const std::optional<SignalSet>& signal_mask = std::nullopt)
+	{
+		const auto count = poll(max_events, timeout, signal_mask);
+		for (int i = 0; i < count; i++) {
+			const auto& event = events[i];
+			if (event.data.u64 & handler_id) {
+				handle(event);
+			} else {
+				dispatcher(event.data.u64, Events(event.events));
+			}
 		}
 		return count;
 	}
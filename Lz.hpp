@@ -0,0 +1,467 @@
+#pragma once
+
+/*
+ * Small LZ77 codec for compressing individual frames, in the LZ4 block
+ * format: each sequence is a token (literal and match length nibbles),
+ * extended literal length, literals, 16-bit little-endian match offset and
+ * extended match length, the last sequence having literals only.
+ *
+ * The compressor is greedy with hash chains, the level setting how many
+ * chain entries are tried per position.  Its tables are kept between calls
+ * and invalidated by moving a base position rather than by clearing them.
+ * The stream compressor keeps a window of earlier frames (optionally primed
+ * with a dictionary) for matches to refer back into.
+ * The decoder checks every length and offset, so corrupt input is rejected
+ * rather than overrunning anything.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+namespace Lz {
+
+static constexpr int max_level = 3;
+
+static constexpr std::size_t min_match = 4;
+static constexpr std::size_t max_offset = 65535;
+
+namespace detail {
+
+inline std::uint32_t load32(const std::uint8_t *p)
+{
+	std::uint32_t value;
+	std::memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+inline std::uint8_t *write_length(std::uint8_t *op, std::size_t length)
+{
+	for (; length >= 255; length -= 255) {
+		*op++ = 255;
+	}
+	*op++ = length;
+	return op;
+}
+
+/*
+ * Greedy hash chain matcher over a buffer holding history followed by new
+ * input.  Positions are absolute and only grow, so entries which fall out of
+ * the buffer or window are recognised without clearing the tables.
+ */
+class Matcher
+{
+	static constexpr int hash_bits = 12;
+
+	/* Latest position with each hash, and previous position with the same hash */
+	std::vector<std::uint32_t> head;
+	std::vector<std::uint32_t> chain;
+	std::uint32_t chain_mask;
+	std::size_t max_distance;
+
+	static std::uint32_t hash(const std::uint8_t *p)
+	{
+		return (load32(p) * 2654435761u) >> (32 - hash_bits);
+	}
+
+	static std::size_t round_to_power_of_two(std::size_t size)
+	{
+		std::size_t value = 1;
+		while (value < size) {
+			value <<= 1;
+		}
+		return value;
+	}
+
+public:
+	/* Matches reach back at most window bytes (at most max_offset) */
+	explicit Matcher(std::size_t window) :
+		head(std::size_t(1) << hash_bits),
+		chain(round_to_power_of_two(std::min(window, max_offset) + 1)),
+		chain_mask(chain.size() - 1),
+		max_distance(std::min(window, max_offset))
+	{
+	}
+
+	std::size_t window() const
+	{
+		return max_distance;
+	}
+
+	/* Forgets all positions (they must be re-based at 1 after this) */
+	void clear()
+	{
+		std::fill(head.begin(), head.end(), 0);
+	}
+
+	/* Makes position of data[i] findable, data must have four bytes from there */
+	void insert(const std::uint8_t *p, std::uint32_t pos)
+	{
+		auto& slot = head[hash(p)];
+		chain[pos & chain_mask] = slot;
+		slot = pos;
+	}
+
+	/*
+	 * Encodes data[history, history + size) into out, matching against
+	 * everything from data[0], where data[0] is at position pos.  History
+	 * must already have been inserted.  Returns encoded size, or zero if it
+	 * would exceed capacity.
+	 */
+	std::size_t encode(const std::uint8_t *data, std::uint32_t pos, std::size_t history, std::size_t size, std::uint8_t *out, std::size_t capacity, int level)
+	{
+		const int probes = 1 << 2 * (std::min(std::max(level, 1), max_level) - 1);
+		const std::uint8_t *in = data + history;
+		const std::uint8_t *end = in + size;
+		const std::uint8_t *limit = size >= min_match ? end - min_match : in - 1;
+		const std::uint8_t *ip = in;
+		const std::uint8_t *anchor = in;
+		std::uint8_t *op = out;
+		std::uint8_t *op_end = out + capacity;
+
+		/* Returns false if out of room */
+		const auto emit = [&] (std::size_t match_length, std::size_t offset) {
+			const std::size_t literals = ip - anchor;
+			if (std::size_t(op_end - op) < 1 + literals / 255 + 1 + literals + 2 + match_length / 255 + 1) {
+				return false;
+			}
+			std::uint8_t *token = op++;
+			*token = (literals < 15 ? literals : 15) << 4;
+			if (literals >= 15) {
+				op = write_length(op, literals - 15);
+			}
+			std::memcpy(op, anchor, literals);
+			op += literals;
+			if (match_length == 0) {
+				return true;
+			}
+			*op++ = offset;
+			*op++ = offset >> 8;
+			match_length -= min_match;
+			*token |= match_length < 15 ? match_length : 15;
+			if (match_length >= 15) {
+				op = write_length(op, match_length - 15);
+			}
+			return true;
+		};
+
+		while (ip <= limit) {
+			const std::uint32_t ip_pos = pos + (ip - data);
+			std::uint32_t candidate = head[hash(ip)];
+			insert(ip, ip_pos);
+			std::size_t best_length = 0;
+			std::size_t best_offset = 0;
+			for (int n = probes; n > 0 && candidate >= pos && ip_pos - candidate <= max_distance; n--) {
+				const std::uint8_t *match = data + (candidate - pos);
+				if (load32(match) == load32(ip)) {
+					std::size_t length = min_match;
+					while (ip + length < end && match[length] == ip[length]) {
+						length++;
+					}
+					if (length > best_length) {
+						best_length = length;
+						best_offset = ip - match;
+					}
+				}
+				candidate = chain[candidate & chain_mask];
+			}
+			if (best_length < min_match) {
+				/* Level 1 skips ahead faster through data which is not matching */
+				ip += level <= 1 ? 1 + ((ip - anchor) >> 5) : 1;
+				continue;
+			}
+			if (!emit(best_length, best_offset)) {
+				return 0;
+			}
+			const std::uint8_t *next = ip + best_length;
+			for (ip++; ip < next && ip <= limit; ip++) {
+				insert(ip, pos + (ip - data));
+			}
+			ip = anchor = next;
+		}
+		ip = end;
+		if (!emit(0, 0)) {
+			return 0;
+		}
+		return op - out;
+	}
+};
+
+}
+
+/* Worst-case encoded size, all literals */
+constexpr std::size_t max_compressed_size(std::size_t size)
+{
+	return size + size / 255 + 2;
+}
+
+/* Compresses frames independently of each other */
+class Compressor
+{
+	detail::Matcher matcher;
+	std::size_t max_input;
+	/* Positions below this belong to earlier calls */
+	std::uint32_t base{1};
+
+public:
+	explicit Compressor(std::size_t max_input) :
+		matcher(max_input),
+		max_input(max_input)
+	{
+	}
+
+	/*
+	 * Compresses size bytes (at most max_input) into out, which must hold
+	 * size bytes.  Returns compressed size, or zero if it would be no smaller.
+	 */
+	std::size_t compress(const std::uint8_t *in, std::size_t size, std::uint8_t *out, int level)
+	{
+		if (size < 2 * min_match || size > max_input) {
+			return 0;
+		}
+		if (base > 0xffffffffu - size) {
+			matcher.clear();
+			base = 1;
+		}
+		/* Reserve this call's positions, whether or not it succeeds */
+		const std::uint32_t first = base;
+		base += size;
+		const auto compressed_size = matcher.encode(in, first, 0, size, out, size, level);
+		return compressed_size < size ? compressed_size : 0;
+	}
+};
+
+/*
+ * Compresses a stream of frames, each matching against those before it (and
+ * an optional dictionary).  The peer's StreamDecompressor must see exactly
+ * the same frames in the same order, including those sent stored.
+ */
+class StreamCompressor
+{
+	detail::Matcher matcher;
+	/* History, then the frame being compressed */
+	std::vector<std::uint8_t> buffer;
+	std::size_t length{0};
+	/* Position of buffer[0] */
+	std::uint32_t pos{1};
+	std::vector<std::uint8_t> dictionary;
+
+	/* Drops all but the last window of history, to make room for size bytes */
+	void make_room(std::size_t size)
+	{
+		if (length + size <= buffer.size()) {
+			return;
+		}
+		const std::size_t keep = std::min(length, matcher.window());
+		std::memmove(buffer.data(), buffer.data() + length - keep, keep);
+		pos += length - keep;
+		length = keep;
+		if (pos > 0xffffffffu - buffer.size()) {
+			/* Positions about to wrap, re-base them */
+			matcher.clear();
+			pos = 1;
+			for (std::size_t i = 0; i + min_match <= length; i++) {
+				matcher.insert(&buffer[i], pos + i);
+			}
+		}
+	}
+
+public:
+	StreamCompressor(std::size_t window, std::size_t max_input, const std::vector<std::uint8_t>& dictionary) :
+		matcher(window),
+		buffer(matcher.window() + max_input),
+		dictionary(dictionary)
+	{
+		reset();
+	}
+
+	std::size_t window() const
+	{
+		return matcher.window();
+	}
+
+	/* Forgets history, starting again from the dictionary */
+	void reset()
+	{
+		matcher.clear();
+		pos = 1;
+		length = std::min(dictionary.size(), matcher.window());
+		std::copy(dictionary.end() - length, dictionary.end(), buffer.begin());
+		for (std::size_t i = 0; i + min_match <= length; i++) {
+			matcher.insert(&buffer[i], pos + i);
+		}
+	}
+
+	/*
+	 * Compresses size bytes (at most max_input) into out, which must hold
+	 * size bytes, and adds them to history.  Returns compressed size, or
+	 * zero if it would be no smaller, in which case the frame must be sent
+	 * stored, since it is in history either way.
+	 */
+	std::size_t compress(const std::uint8_t *in, std::size_t size, std::uint8_t *out, int level)
+	{
+		make_room(size);
+		std::memcpy(&buffer[length], in, size);
+		const auto compressed_size = matcher.encode(buffer.data(), pos, length, size, out, size, level);
+		length += size;
+		return compressed_size < size ? compressed_size : 0;
+	}
+};
+
+/* Decompresses into out, matches may refer back as far as history, returns size, or zero if corrupt or over capacity */
+inline std::size_t decompress(const std::uint8_t *in, std::size_t size, const std::uint8_t *history, std::uint8_t *out, std::size_t capacity)
+{
+	const std::uint8_t *ip = in;
+	const std::uint8_t *end = in + size;
+	std::uint8_t *op = out;
+	std::uint8_t *op_end = out + capacity;
+	const auto read_length = [&] (std::size_t& length) {
+		std::uint8_t byte;
+		do {
+			if (ip == end) {
+				return false;
+			}
+			byte = *ip++;
+			length += byte;
+		} while (byte == 255);
+		return true;
+	};
+	while (ip != end) {
+		const std::uint8_t token = *ip++;
+		std::size_t literals = token >> 4;
+		if (literals == 15 && !read_length(literals)) {
+			return 0;
+		}
+		if (std::size_t(end - ip) < literals || std::size_t(op_end - op) < literals) {
+			return 0;
+		}
+		std::memcpy(op, ip, literals);
+		ip += literals;
+		op += literals;
+		if (ip == end) {
+			break;
+		}
+		if (end - ip < 2) {
+			return 0;
+		}
+		const std::size_t offset = ip[0] | ip[1] << 8;
+		ip += 2;
+		std::size_t length = token & 0x0f;
+		if (length == 15 && !read_length(length)) {
+			return 0;
+		}
+		length += min_match;
+		if (offset == 0 || offset > std::size_t(op - history) || std::size_t(op_end - op) < length) {
+			return 0;
+		}
+		/* Byte by byte, matches may overlap their own output */
+		const std::uint8_t *match = op - offset;
+		for (std::size_t i = 0; i < length; i++) {
+			op[i] = match[i];
+		}
+		op += length;
+	}
+	return op - out;
+}
+
+inline std::size_t decompress(const std::uint8_t *in, std::size_t size, std::uint8_t *out, std::size_t capacity)
+{
+	return decompress(in, size, out, out, capacity);
+}
+
+/* Counterpart of StreamCompressor */
+class StreamDecompressor
+{
+	std::size_t window;
+	std::vector<std::uint8_t> buffer;
+	std::size_t length{0};
+	/* Start of last frame */
+	std::size_t last{0};
+	std::vector<std::uint8_t> dictionary;
+
+	void make_room(std::size_t size)
+	{
+		if (length + size <= buffer.size()) {
+			return;
+		}
+		const std::size_t keep = std::min(length, window);
+		std::memmove(buffer.data(), buffer.data() + length - keep, keep);
+		length = keep;
+	}
+
+public:
+	/* Window must be at least the compressor's */
+	StreamDecompressor(std::size_t window, std::size_t max_output, const std::vector<std::uint8_t>& dictionary) :
+		window(window),
+		buffer(window + max_output),
+		dictionary(dictionary)
+	{
+		reset();
+	}
+
+	void reset()
+	{
+		length = std::min(dictionary.size(), window);
+		std::copy(dictionary.end() - length, dictionary.end(), buffer.begin());
+	}
+
+	/*
+	 * Decompresses frame and adds it to history.  Returns its size (it is at
+	 * data(), until the next call), or zero if corrupt, after which the
+	 * history is unusable until reset.
+	 */
+	std::size_t decompress(const std::uint8_t *in, std::size_t size)
+	{
+		make_room(buffer.size() - window);
+		const auto out_size = Lz::decompress(in, size, buffer.data(), &buffer[length], buffer.size() - length);
+		last = length;
+		length += out_size;
+		return out_size;
+	}
+
+	/* Adds frame which was sent stored to history */
+	std::size_t store(const std::uint8_t *in, std::size_t size)
+	{
+		make_room(size);
+		if (length + size > buffer.size()) {
+			return 0;
+		}
+		std::memcpy(&buffer[length], in, size);
+		last = length;
+		length += size;
+		return size;
+	}
+
+	/* Last frame decompressed or stored */
+	std::uint8_t *data()
+	{
+		return &buffer[last];
+	}
+};
+
+/* Order-0 entropy in bits per byte, estimated from up to 512 evenly spaced bytes */
+inline double entropy(const std::uint8_t *data, std::size_t size)
+{
+	constexpr std::size_t samples = 512;
+	const std::size_t stride = size > samples ? size / samples : 1;
+	std::uint16_t counts[256] = {};
+	std::size_t n = 0;
+	for (std::size_t i = 0; i < size && n < samples; i += stride, n++) {
+		counts[data[i]]++;
+	}
+	if (n == 0) {
+		return 0;
+	}
+	double sum = 0;
+	for (const auto count : counts) {
+		if (count > 0) {
+			sum += count * std::log2(double(count));
+		}
+	}
+	return std::log2(double(n)) - sum / n;
+}
+
+}
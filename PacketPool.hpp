@@ -0,0 +1,199 @@
+#pragma once
+
+/*
+ * Fixed-size slab of packet buffers, allocated once on construction.
+ *
+ * Each buffer holds one whole frame, with headroom in front of the payload
+ * (so headers can be prepended without moving it) and tailroom after it.
+ * Buffers are handed out as refcounted handles: copying a handle shares the
+ * buffer, which goes back on the free list when the last handle is dropped.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <utility>
+
+class PacketPool
+{
+public:
+	static constexpr std::size_t headroom = 16;
+	static constexpr std::size_t tailroom = 16;
+
+	class Buffer
+	{
+		friend class PacketPool;
+
+		PacketPool *pool{nullptr};
+		std::uint32_t index{0};
+		/* Payload range, relative to start of slab */
+		std::uint32_t offset{0};
+		std::uint32_t length{0};
+
+		Buffer(PacketPool *pool, std::uint32_t index) :
+			pool(pool),
+			index(index),
+			offset(headroom)
+		{
+		}
+
+		void release()
+		{
+			if (pool) {
+				pool->unref(index);
+				pool = nullptr;
+			}
+		}
+
+	public:
+		Buffer() = default;
+
+		Buffer(const Buffer& other) :
+			pool(other.pool),
+			index(other.index),
+			offset(other.offset),
+			length(other.length)
+		{
+			if (pool) {
+				pool->refs[index]++;
+			}
+		}
+
+		Buffer(Buffer&& other) :
+			pool(std::exchange(other.pool, nullptr)),
+			index(other.index),
+			offset(other.offset),
+			length(other.length)
+		{
+		}
+
+		Buffer& operator = (Buffer other)
+		{
+			std::swap(pool, other.pool);
+			std::swap(index, other.index);
+			std::swap(offset, other.offset);
+			std::swap(length, other.length);
+			return *this;
+		}
+
+		~Buffer()
+		{
+			release();
+		}
+
+		explicit operator bool () const
+		{
+			return pool != nullptr;
+		}
+
+		std::uint8_t *data()
+		{
+			return pool->slab(index) + offset;
+		}
+
+		const std::uint8_t *data() const
+		{
+			return pool->slab(index) + offset;
+		}
+
+		std::size_t size() const
+		{
+			return length;
+		}
+
+		/* Room for payload from data() onwards, including tailroom */
+		std::size_t capacity() const
+		{
+			return pool->buffer_size - offset;
+		}
+
+		void resize(std::size_t size)
+		{
+			length = size;
+		}
+
+		/* Grows payload at the front (into headroom), returns new data() */
+		std::uint8_t *push_front(std::size_t size)
+		{
+			offset -= size;
+			length += size;
+			return data();
+		}
+
+		/* Removes bytes from front of payload */
+		void pop_front(std::size_t size)
+		{
+			offset += size;
+			length -= size;
+		}
+	};
+
+private:
+	std::size_t buffer_size;
+	std::vector<std::uint8_t> storage;
+	std::vector<std::uint32_t> refs;
+	std::vector<std::uint32_t> free_list;
+
+	std::uint8_t *slab(std::uint32_t index)
+	{
+		return &storage[index * buffer_size];
+	}
+
+	void unref(std::uint32_t index)
+	{
+		if (--refs[index] == 0) {
+			free_list.push_back(index);
+		}
+	}
+
+public:
+	/* Pool of count buffers, each with room for max_size bytes of payload */
+	PacketPool(std::size_t count, std::size_t max_size) :
+		buffer_size(headroom + max_size + tailroom),
+		storage(count * buffer_size),
+		refs(count),
+		free_list(count)
+	{
+		for (std::size_t i = 0; i < count; i++) {
+			free_list[i] = count - 1 - i;
+		}
+	}
+
+	PacketPool(const PacketPool&) = delete;
+	void operator = (const PacketPool&) = delete;
+
+	/* Empty buffer, or a null handle if the pool is exhausted */
+	Buffer alloc()
+	{
+		if (free_list.empty()) {
+			return {};
+		}
+		const auto index = free_list.back();
+		free_list.pop_back();
+		refs[index] = 1;
+		return Buffer(this, index);
+	}
+
+	/* Buffer holding a copy of data, or a null handle if the pool is exhausted */
+	Buffer alloc(const void *data, std::size_t size)
+	{
+		Buffer buffer = alloc();
+		if (buffer) {
+			std::memcpy(buffer.data(), data, size);
+			buffer.resize(size);
+		}
+		return buffer;
+	}
+
+	std::size_t available() const
+	{
+		return free_list.size();
+	}
+
+	/* Largest payload a buffer can hold, excluding headroom and tailroom */
+	std::size_t max_size() const
+	{
+		return buffer_size - headroom - tailroom;
+	}
+};
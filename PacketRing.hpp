@@ -0,0 +1,147 @@
+#pragma once
+
+/*
+ * Fixed-capacity FIFO of variable-length packets, stored in one contiguous
+ * buffer which is allocated once on construction.
+ *
+ * Each packet is stored as a length header followed by the payload.  A record
+ * never straddles the end of the buffer, so packets are always handed out as
+ * a plain pointer/length pair.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+class PacketRing
+{
+	using Header = std::uint32_t;
+
+	static constexpr std::size_t alignment = alignof(Header);
+
+	std::vector<std::uint8_t> storage;
+
+	/* Offset of oldest record */
+	std::size_t head{0};
+	/* Offset of next record to write */
+	std::size_t tail{0};
+	/* When wrapped, end of the records at the top of the buffer */
+	std::size_t limit{0};
+	bool wrapped{false};
+
+	std::size_t count{0};
+
+	static std::size_t record_size(std::size_t size)
+	{
+		return (sizeof(Header) + size + alignment - 1) & ~(alignment - 1);
+	}
+
+	std::uint8_t *write_record(std::size_t offset, const void *data, std::size_t size)
+	{
+		const Header header = size;
+		std::memcpy(&storage[offset], &header, sizeof(header));
+		std::memcpy(&storage[offset + sizeof(header)], data, size);
+		return &storage[offset + sizeof(header)];
+	}
+
+	Header read_header() const
+	{
+		Header header;
+		std::memcpy(&header, &storage[head], sizeof(header));
+		return header;
+	}
+
+public:
+	explicit PacketRing(std::size_t capacity) :
+		storage(capacity)
+	{
+	}
+
+	bool empty() const
+	{
+		return count == 0;
+	}
+
+	std::size_t size() const
+	{
+		return count;
+	}
+
+	/* Bytes of storage in use, including headers and padding */
+	std::size_t size_bytes() const
+	{
+		return wrapped ? limit - head + tail : tail - head;
+	}
+
+	std::size_t capacity() const
+	{
+		return storage.size();
+	}
+
+	/* Largest packet which could ever be stored */
+	std::size_t max_packet_size() const
+	{
+		return storage.size() - sizeof(Header);
+	}
+
+	void clear()
+	{
+		head = 0;
+		tail = 0;
+		wrapped = false;
+		count = 0;
+	}
+
+	/* Copies packet into ring, returns false if there is not enough room */
+	bool push(const void *data, std::size_t size)
+	{
+		const auto need = record_size(size);
+		std::size_t offset;
+		if (!wrapped) {
+			if (storage.size() - tail >= need) {
+				offset = tail;
+			} else if (head >= need) {
+				limit = tail;
+				wrapped = true;
+				offset = 0;
+			} else {
+				return false;
+			}
+		} else if (head - tail >= need) {
+			offset = tail;
+		} else {
+			return false;
+		}
+		write_record(offset, data, size);
+		tail = offset + need;
+		count++;
+		return true;
+	}
+
+	/*
+	 * Oldest packet; the range remains valid after pop() until the next
+	 * push()
+	 */
+	std::uint8_t *front_data()
+	{
+		return &storage[head + sizeof(Header)];
+	}
+
+	std::size_t front_size() const
+	{
+		return read_header();
+	}
+
+	void pop()
+	{
+		head += record_size(read_header());
+		count--;
+		if (count == 0) {
+			clear();
+		} else if (wrapped && head == limit) {
+			head = 0;
+			wrapped = false;
+		}
+	}
+};
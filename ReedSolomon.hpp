@@ -0,0 +1,319 @@
+#pragma once
+
+/*
+ * Reed-Solomon forward error correction over GF(256), for frames crossing a
+ * noisy link.
+ *
+ * A frame is split into blocks of nearly equal size, each short enough that
+ * it and its parity fit a 255-byte codeword (shortened as needed).  Every
+ * block is followed by its parity, so the coded frame carries no header: the
+ * data size follows from the coded size.  With p parity bytes, up to p/2
+ * corrupted bytes per block are corrected.
+ *
+ * Field polynomial x^8+x^4+x^3+x^2+1, generator roots a^0 .. a^(p-1).
+ * Encoding and syndromes use a 256-entry multiplication table per parity
+ * byte; the rest of decoding (Berlekamp-Massey, Chien search, Forney) runs
+ * only on blocks with errors.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace ReedSolomon {
+
+/* Longest codeword: data and parity */
+static constexpr std::size_t max_block = 255;
+
+/* Most parity bytes per block */
+static constexpr std::size_t max_parity = 64;
+
+/* Coded size of a frame of size bytes */
+inline std::size_t encoded_size(std::size_t size, std::size_t parity)
+{
+	const auto block_data = max_block - parity;
+	return size + (size + block_data - 1) / block_data * parity;
+}
+
+namespace detail {
+
+struct Field
+{
+	/* Doubled, so exp[log a + log b] needs no reduction */
+	std::uint8_t exp[2 * 255];
+	std::uint8_t log[256];
+
+	Field()
+	{
+		unsigned x = 1;
+		for (unsigned i = 0; i < 255; i++) {
+			exp[i] = exp[i + 255] = x;
+			log[x] = i;
+			x <<= 1;
+			if (x & 0x100) {
+				x ^= 0x11d;
+			}
+		}
+		log[0] = 0;
+	}
+
+	std::uint8_t mul(std::uint8_t a, std::uint8_t b) const
+	{
+		return a && b ? exp[log[a] + log[b]] : 0;
+	}
+
+	std::uint8_t div(std::uint8_t a, std::uint8_t b) const
+	{
+		return a ? exp[log[a] + 255 - log[b]] : 0;
+	}
+
+	/* a^power */
+	std::uint8_t pow(unsigned power) const
+	{
+		return exp[power % 255];
+	}
+};
+
+inline const Field& field()
+{
+	static const Field instance;
+	return instance;
+}
+
+}
+
+class Codec
+{
+	std::size_t parity;
+	/* Row j multiplies by the generator coefficient feeding parity byte j */
+	std::vector<std::uint8_t> generator_tables;
+	/* Row i multiplies by a^i, for syndrome i */
+	std::vector<std::uint8_t> syndrome_tables;
+
+	/* Evaluates polynomial (coefficients lowest degree first) at a^power */
+	static std::uint8_t evaluate(const std::uint8_t *poly, std::size_t count, unsigned power)
+	{
+		const auto& gf = detail::field();
+		std::uint8_t value = 0;
+		for (std::size_t i = count; i-- > 0; ) {
+			value = gf.mul(value, gf.pow(power)) ^ poly[i];
+		}
+		return value;
+	}
+
+public:
+	/* parity must be 1 .. max_parity */
+	explicit Codec(std::size_t parity) :
+		parity(parity),
+		generator_tables(parity * 256),
+		syndrome_tables(parity * 256)
+	{
+		const auto& gf = detail::field();
+		/* Generator, lowest degree first: product of (x - a^i) */
+		std::vector<std::uint8_t> generator(parity + 1);
+		generator[0] = 1;
+		for (std::size_t i = 0; i < parity; i++) {
+			for (std::size_t j = i + 1; j > 0; j--) {
+				generator[j] = generator[j - 1] ^ gf.mul(generator[j], gf.pow(i));
+			}
+			generator[0] = gf.mul(generator[0], gf.pow(i));
+		}
+		for (std::size_t j = 0; j < parity; j++) {
+			for (unsigned x = 0; x < 256; x++) {
+				generator_tables[j * 256 + x] = gf.mul(x, generator[parity - 1 - j]);
+				syndrome_tables[j * 256 + x] = gf.mul(x, gf.pow(j));
+			}
+		}
+	}
+
+	std::size_t get_parity() const
+	{
+		return parity;
+	}
+
+	std::size_t encoded_size(std::size_t size) const
+	{
+		return ReedSolomon::encoded_size(size, parity);
+	}
+
+	/* Size of the frame coded as size bytes, zero if no frame codes to that size */
+	std::size_t decoded_size(std::size_t size) const
+	{
+		const auto blocks = (size + max_block - 1) / max_block;
+		if (size <= blocks * parity) {
+			return 0;
+		}
+		const auto data_size = size - blocks * parity;
+		return encoded_size(data_size) == size ? data_size : 0;
+	}
+
+	/* Writes parity of a block (size at most max_block - parity) to out */
+	void encode_block(const std::uint8_t *data, std::size_t size, std::uint8_t *out) const
+	{
+		std::memset(out, 0, parity);
+		for (std::size_t i = 0; i < size; i++) {
+			const std::uint8_t *row = generator_tables.data();
+			const std::uint8_t feedback = data[i] ^ out[0];
+			for (std::size_t j = 0; j + 1 < parity; j++, row += 256) {
+				out[j] = out[j + 1] ^ row[feedback];
+			}
+			out[parity - 1] = row[feedback];
+		}
+	}
+
+	/*
+	 * Corrects a block (data followed by parity, size at most max_block) in
+	 * place, returns the number of bytes corrected, or -1 if there are too
+	 * many errors (the block is then left as it was)
+	 */
+	int decode_block(std::uint8_t *block, std::size_t size) const
+	{
+		const auto& gf = detail::field();
+		std::uint8_t syndromes[max_parity] = {};
+		/* Syndromes are independent, so step several together for instruction-level parallelism */
+		for (std::size_t k = 0; k < size; k++) {
+			const std::uint8_t *row = syndrome_tables.data();
+			for (std::size_t i = 0; i < parity; i++, row += 256) {
+				syndromes[i] = row[syndromes[i]] ^ block[k];
+			}
+		}
+		bool clean = true;
+		for (std::size_t i = 0; i < parity; i++) {
+			clean = clean && syndromes[i] == 0;
+		}
+		if (clean) {
+			return 0;
+		}
+
+		/* Berlekamp-Massey: error locator, lowest degree first */
+		std::uint8_t locator[max_parity + 1] = { 1 };
+		std::uint8_t previous[max_parity + 1] = { 1 };
+		std::uint8_t scratch[max_parity + 1];
+		std::size_t errors = 0;
+		std::size_t shift = 1;
+		std::uint8_t previous_discrepancy = 1;
+		for (std::size_t n = 0; n < parity; n++) {
+			std::uint8_t discrepancy = syndromes[n];
+			for (std::size_t i = 1; i <= errors; i++) {
+				discrepancy ^= gf.mul(locator[i], syndromes[n - i]);
+			}
+			if (discrepancy == 0) {
+				shift++;
+				continue;
+			}
+			const auto scale = gf.div(discrepancy, previous_discrepancy);
+			const bool grow = 2 * errors <= n;
+			if (grow) {
+				std::memcpy(scratch, locator, sizeof(locator));
+			}
+			for (std::size_t i = 0; i + shift <= parity; i++) {
+				locator[i + shift] ^= gf.mul(scale, previous[i]);
+			}
+			if (grow) {
+				errors = n + 1 - errors;
+				std::memcpy(previous, scratch, sizeof(previous));
+				previous_discrepancy = discrepancy;
+				shift = 1;
+			} else {
+				shift++;
+			}
+		}
+		if (2 * errors > parity) {
+			return -1;
+		}
+
+		/* Error evaluator: syndromes times locator, mod x^parity */
+		std::uint8_t evaluator[max_parity];
+		for (std::size_t i = 0; i < parity; i++) {
+			evaluator[i] = 0;
+			for (std::size_t j = 0; j <= i && j <= errors; j++) {
+				evaluator[i] ^= gf.mul(syndromes[i - j], locator[j]);
+			}
+		}
+		/* Formal derivative of the locator */
+		std::uint8_t derivative[max_parity];
+		for (std::size_t i = 0; i < errors; i++) {
+			derivative[i] = (i & 1) ? 0 : locator[i + 1];
+		}
+
+		/* Chien search over the (shortened) block, then Forney for each value */
+		std::size_t positions[max_parity / 2];
+		std::uint8_t values[max_parity / 2];
+		std::size_t found = 0;
+		for (std::size_t k = 0; k < size && found < errors; k++) {
+			/* Byte k is the coefficient of x^(size - 1 - k), its inverse locator is a^-(size - 1 - k) */
+			const unsigned degree = size - 1 - k;
+			const unsigned inverse = (255 - degree) % 255;
+			if (evaluate(locator, errors + 1, inverse) != 0) {
+				continue;
+			}
+			const auto denominator = evaluate(derivative, errors, inverse);
+			if (denominator == 0) {
+				return -1;
+			}
+			positions[found] = k;
+			values[found] = gf.mul(gf.pow(degree), gf.div(evaluate(evaluator, parity, inverse), denominator));
+			found++;
+		}
+		if (found != errors) {
+			return -1;
+		}
+		for (std::size_t i = 0; i < found; i++) {
+			block[positions[i]] ^= values[i];
+		}
+		return found;
+	}
+
+	/* Encodes frame into out (encoded_size(size) bytes), returns coded size */
+	std::size_t encode(const std::uint8_t *in, std::size_t size, std::uint8_t *out) const
+	{
+		const auto block_data = max_block - parity;
+		const auto blocks = (size + block_data - 1) / block_data;
+		std::uint8_t *o = out;
+		for (std::size_t i = 0; i < blocks; i++) {
+			const auto block_size = size / blocks + (i < size % blocks);
+			std::memcpy(o, in, block_size);
+			encode_block(in, block_size, o + block_size);
+			in += block_size;
+			o += block_size + parity;
+		}
+		return o - out;
+	}
+
+	/*
+	 * Corrects coded frame in place and moves its data to the front, size
+	 * becomes the data size (zero if no frame codes to size).  Returns the
+	 * number of bytes corrected, or -1 if any block had too many errors (its
+	 * data is left as received, for the frame check to judge).
+	 */
+	int decode(std::uint8_t *frame, std::size_t& size) const
+	{
+		const auto data_size = decoded_size(size);
+		if (data_size == 0) {
+			size = 0;
+			return -1;
+		}
+		const auto blocks = (size + max_block - 1) / max_block;
+		std::uint8_t *in = frame;
+		std::uint8_t *out = frame;
+		int corrected = 0;
+		bool uncorrectable = false;
+		for (std::size_t i = 0; i < blocks; i++) {
+			const auto block_size = data_size / blocks + (i < data_size % blocks);
+			const auto result = decode_block(in, block_size + parity);
+			if (result < 0) {
+				uncorrectable = true;
+			} else {
+				corrected += result;
+			}
+			std::memmove(out, in, block_size);
+			in += block_size + parity;
+			out += block_size;
+		}
+		size = data_size;
+		return uncorrectable ? -1 : corrected;
+	}
+};
+
+}
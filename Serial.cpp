@@ -1,6 +1,7 @@
 #include <unordered_map>
 
 #include <termios.h>
+#include <sys/ioctl.h>
 #include <unistd.h>
 #include <fcntl.h>
 
@@ -73,4 +74,11 @@ Serial::Serial(const std::string& path, int baud, Flags flags) :
 	}
 }
 
+std::size_t Serial::output_queue_size()
+{
+	int size;
+	ioctl(TIOCOUTQ, &size);
+	return size;
+}
+
 }
@@ -9,6 +9,9 @@ struct Serial :
 	WritableFileDescriptor
 {
 	Serial(const std::string& path, int baud, Flags flags = Flags::none);
+
+	/* Bytes written but not yet transmitted by the driver */
+	std::size_t output_queue_size();
 };
 
 }
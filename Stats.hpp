@@ -8,9 +8,84 @@ namespace IpLink {
 /* Using X-macro pattern */
 
 #define X_STATS \
+		X(loop_wakeups) \
+		X(loop_events) \
+		X(uart_rx_reads) \
+		X(tun_rx_reads) \
+		\
 		X(uart_rx_bytes) \
 		X(uart_tx_bytes) \
 		X(uart_rx_errors) \
+		X(uart_rx_overflows) \
+		X(uart_tx_overflows) \
+		\
+		X(kiss_overhead_bytes) \
+		X(cobs_overhead_bytes) \
+		X(link_option_mismatches) \
+		X(framing_mismatches) \
+		X(fec_tx_parity_bytes) \
+		X(fec_corrected_frames) \
+		X(fec_corrected_bytes) \
+		X(fec_uncorrectable_frames) \
+		\
+		X(tx_control_frames) \
+		X(tx_control_drops) \
+		X(tx_interactive_frames) \
+		X(tx_interactive_drops) \
+		X(tx_bulk_frames) \
+		X(tx_bulk_drops) \
+		X(tx_aqm_drops) \
+		X(tx_pool_drops) \
+		X(tx_ecn_marks) \
+		X(tx_dequeued_frames) \
+		X(tx_sojourn_ms) \
+		\
+		X(tcp_hc_compressed) \
+		X(tcp_hc_uncompressed) \
+		X(tcp_hc_header_bytes) \
+		X(tcp_hc_compressed_bytes) \
+		X(tcp_hc_rx_tossed) \
+		X(tcp_hc_rx_errors) \
+		X(udp_hc_compressed) \
+		X(udp_hc_full) \
+		X(udp_hc_header_bytes) \
+		X(udp_hc_compressed_bytes) \
+		X(udp_hc_rx_errors) \
+		\
+		X(lz_frames) \
+		X(lz_bypassed) \
+		X(lz_incompressible) \
+		X(lz_fast_frames) \
+		X(lz_bytes_in) \
+		X(lz_bytes_out) \
+		X(lz_rx_errors) \
+		X(lz_stream_frames) \
+		X(lz_stream_stored) \
+		X(lz_stream_resets) \
+		X(lz_stream_rx_dropped) \
+		\
+		X(tx_aggregates) \
+		X(tx_aggregated_frames) \
+		X(rx_aggregates) \
+		X(rx_aggregate_errors) \
+		\
+		X(tx_fragmented_frames) \
+		X(tx_fragments) \
+		X(rx_fragments) \
+		X(rx_reassembled_frames) \
+		X(rx_reassembly_errors) \
+		X(rx_reassembly_timeouts) \
+		\
+		X(arq_frames) \
+		X(arq_retransmits) \
+		X(arq_timeouts) \
+		X(arq_window_stalls) \
+		X(arq_acks) \
+		X(arq_rtt_samples) \
+		X(arq_rtt_us) \
+		X(arq_rx_out_of_order) \
+		X(arq_rx_duplicates) \
+		X(arq_rx_errors) \
 		\
 		X(tun_rx_bytes) \
 		X(tun_tx_bytes) \
@@ -34,6 +109,24 @@ public:
 #define X(name) os << "\t" << #name << ": " << name << std::endl;
 		X_STATS;
 #undef X
+		if (tx_dequeued_frames > 0) {
+			os << "\t" << "tx_mean_sojourn_ms: " << tx_sojourn_ms / tx_dequeued_frames << std::endl;
+		}
+		if (tcp_hc_header_bytes > 0) {
+			os << "\t" << "tcp_hc_ratio: " << double(tcp_hc_compressed_bytes) / tcp_hc_header_bytes << std::endl;
+		}
+		if (udp_hc_header_bytes > 0) {
+			os << "\t" << "udp_hc_ratio: " << double(udp_hc_compressed_bytes) / udp_hc_header_bytes << std::endl;
+		}
+		if (lz_bytes_in > 0) {
+			os << "\t" << "lz_ratio: " << double(lz_bytes_out) / lz_bytes_in << std::endl;
+		}
+		if (tx_aggregates > 0) {
+			os << "\t" << "tx_aggregation_factor: " << double(tx_aggregated_frames) / tx_aggregates << std::endl;
+		}
+		if (arq_rtt_samples > 0) {
+			os << "\t" << "arq_mean_rtt_ms: " << arq_rtt_us / arq_rtt_samples / 1000.0 << std::endl;
+		}
 		os << std::endl;
 	}
 
@@ -0,0 +1,61 @@
+#pragma once
+
+/*
+ * Token bucket rate limiter: tokens (bytes) accrue at a fixed rate up to a
+ * burst size, and are spent as data is sent.
+ */
+
+#include <cstddef>
+#include <chrono>
+#include <algorithm>
+
+class TokenBucket
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+private:
+	/* Bytes per second */
+	double rate;
+	double burst;
+	double tokens;
+	Clock::time_point last;
+
+	void refill(Clock::time_point now)
+	{
+		tokens = std::min(burst, tokens + rate * std::chrono::duration<double>(now - last).count());
+		last = now;
+	}
+
+public:
+	TokenBucket(double rate, double burst) :
+		rate(rate),
+		burst(burst),
+		tokens(burst),
+		last(Clock::now())
+	{
+	}
+
+	/* Bytes which may be sent now */
+	std::size_t available(Clock::time_point now)
+	{
+		refill(now);
+		return tokens > 0 ? std::size_t(tokens) : 0;
+	}
+
+	void consume(std::size_t size)
+	{
+		tokens -= size;
+	}
+
+	/* Time until size bytes may be sent (capped at the burst size) */
+	std::chrono::milliseconds time_until(std::size_t size, Clock::time_point now)
+	{
+		refill(now);
+		const double needed = std::min<double>(size, burst) - tokens;
+		if (needed <= 0) {
+			return std::chrono::milliseconds(0);
+		}
+		return std::chrono::milliseconds(std::size_t(1000 * needed / rate) + 1);
+	}
+};
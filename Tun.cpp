@@ -1,4 +1,5 @@
 #include <net/if.h>
+#include <sys/uio.h>
 
 extern "C" {
 #include "if.h"
@@ -9,17 +10,17 @@ extern "C" {
 
 namespace Linux {
 
-static int tun_fd_init(const std::string& name, char out[IFNAMSIZ + 1], Flags flags)
+static int tun_fd_init(const std::string& name, char out[IFNAMSIZ + 1], Flags flags, bool no_pi)
 {
-	int fd = tun_fd(name.c_str(), out, detail::translate_flags(flags, O_NONBLOCK, O_CLOEXEC));
+	int fd = tun_fd(name.c_str(), out, detail::translate_flags(flags, O_NONBLOCK, O_CLOEXEC), no_pi);
 	if (fd == -1) {
 		out[0] = 0;
 	}
 	return fd;
 }
 
-Tun::Tun(const std::string& name, Flags flags) :
-	FileDescriptor(tun_fd_init(name, this->name, flags), "tun_fd"),
+Tun::Tun(const std::string& name, Flags flags, bool no_pi) :
+	FileDescriptor(tun_fd_init(name, this->name, flags, no_pi), "tun_fd"),
 	mtu(1280)
 {
 }
@@ -39,11 +40,23 @@ Tun::Frame Tun::recv()
 	return frame;
 }
 
+bool Tun::try_recv(Frame& frame)
+{
+	const auto size = try_read(frame.buffer, sizeof(struct tun_frame_info) + mtu);
+	frame.size = size.value_or(0);
+	return size.has_value();
+}
+
 void Tun::send(const Frame& frame)
 {
 	write(frame.buffer, frame.size);
 }
 
+void Tun::send(const struct iovec *iov, int count)
+{
+	detail::assert_not_negative("writev", ::writev(get_fd(), iov, count));
+}
+
 const std::string Tun::get_name() const
 {
 	return static_cast<const char *>(name);
@@ -61,6 +74,7 @@ void Tun::set_mtu(std::size_t mtu)
 	if (if_set_mtu(name, mtu) < 0) {
 		throw SystemError("Failed to configure interface MTU");
 	}
+	this->mtu = mtu;
 }
 
 void Tun::set_up(bool value)
@@ -3,6 +3,7 @@
 #include <utility>
 
 #include <net/if.h>
+#include <sys/uio.h>
 
 extern "C" {
 #include "tun.h"
@@ -29,11 +30,19 @@ struct Tun :
 		~Frame() { if (owns) { free(buffer); } }
 	};
 
-	Tun(const std::string& name, Flags flags = Flags::none);
+	/* With no_pi, packets are read and written without tun_frame_info */
+	Tun(const std::string& name, Flags flags = Flags::none, bool no_pi = false);
 	~Tun();
 
 	Tun::Frame recv();
+	/*
+	 * Reads into caller's frame (buffer must hold tun_frame_info and MTU),
+	 * returns false if nothing was pending
+	 */
+	bool try_recv(Frame& frame);
 	void send(const Frame& frame);
+	/* Sends one frame gathered from several parts */
+	void send(const struct iovec *iov, int count);
 
 	const std::string get_name() const;
 
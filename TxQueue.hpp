@@ -0,0 +1,114 @@
+#pragma once
+
+/*
+ * FIFO of unencoded frames waiting for the UART, bounded in bytes.  Frames
+ * stay here (where they can still be reordered or dropped) until the
+ * transmit ring is shallow enough to take them.
+ *
+ * Frames are pool buffers, queued by handle without copying.  The queue
+ * itself is a circular array which only grows, so it stops allocating once
+ * it has seen its deepest backlog.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <vector>
+
+#include "PacketPool.hpp"
+
+class TxQueue
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	struct Packet
+	{
+		std::uint8_t frame_type;
+		PacketPool::Buffer data;
+		/* For measuring sojourn time */
+		Clock::time_point enqueued;
+	};
+
+private:
+	std::vector<Packet> packets;
+	std::size_t head{0};
+	std::size_t count{0};
+	std::size_t bytes{0};
+	std::size_t limit;
+
+	void grow()
+	{
+		std::vector<Packet> next(packets.empty() ? 8 : 2 * packets.size());
+		for (std::size_t i = 0; i < count; i++) {
+			next[i] = std::move(packets[(head + i) % packets.size()]);
+		}
+		packets = std::move(next);
+		head = 0;
+	}
+
+public:
+	explicit TxQueue(std::size_t limit) :
+		limit(limit)
+	{
+	}
+
+	bool empty() const
+	{
+		return count == 0;
+	}
+
+	std::size_t size() const
+	{
+		return count;
+	}
+
+	/* Payload bytes queued */
+	std::size_t size_bytes() const
+	{
+		return bytes;
+	}
+
+	/* Appends the frame, returns false (tail drop) if full */
+	bool push(std::uint8_t frame_type, PacketPool::Buffer&& data)
+	{
+		const auto size = data.size();
+		if (bytes + size > limit && count > 0) {
+			return false;
+		}
+		if (count == packets.size()) {
+			grow();
+		}
+		packets[(head + count) % packets.size()] = { frame_type, std::move(data), Clock::now() };
+		count++;
+		bytes += size;
+		return true;
+	}
+
+	Packet& front()
+	{
+		return packets[head];
+	}
+
+	const Packet& front() const
+	{
+		return packets[head];
+	}
+
+	void pop()
+	{
+		auto& packet = packets[head];
+		bytes -= packet.data.size();
+		/* Return buffer to its pool now rather than when the slot is reused */
+		packet.data = {};
+		head = (head + 1) % packets.size();
+		count--;
+	}
+
+	void clear()
+	{
+		while (count > 0) {
+			pop();
+		}
+	}
+};
@@ -0,0 +1,482 @@
+#pragma once
+
+/*
+ * Van Jacobson TCP/IP header compression (RFC 1144), for IPv4 TCP.
+ *
+ * Both ends keep a copy of the last header sent on each of a number of
+ * connection slots.  Once a slot is established (by an "uncompressed" packet,
+ * which is the original packet tagged with its slot), later packets on that
+ * connection are sent as a bitmask of changed fields plus small deltas,
+ * typically 3-5 bytes in place of 40.
+ *
+ * Beyond RFC 1144, the TCP timestamp option (RFC 7323), which modern stacks
+ * put on every segment, is delta-encoded rather than forcing the packet out
+ * uncompressed; it is flagged by the otherwise unused top bit of the change
+ * mask.
+ *
+ * The compressor must see packets in exactly the order they are sent.  When
+ * frames are lost, the decompressor tosses compressed packets until the next
+ * one which names its slot explicitly.  TCP then retransmits, and a segment
+ * which repeats or goes back on the last sequence number is sent uncompressed,
+ * which re-establishes the slot; a retransmission which carries a new ACK or
+ * window may still be compressed, and be tossed in turn.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "IpHeader.hpp"
+
+namespace Vj {
+
+/* Change mask bits */
+static constexpr std::uint8_t new_u = 0x01;
+static constexpr std::uint8_t new_w = 0x02;
+static constexpr std::uint8_t new_a = 0x04;
+static constexpr std::uint8_t new_s = 0x08;
+static constexpr std::uint8_t new_i = 0x20;
+static constexpr std::uint8_t new_c = 0x40;
+static constexpr std::uint8_t new_t = 0x80;
+static constexpr std::uint8_t tcp_push = 0x10;
+/* Impossible combinations of u/w/a/s reused for the common cases */
+static constexpr std::uint8_t specials_mask = new_s | new_a | new_w | new_u;
+/* Echoed interactive traffic: seq and ack both advance by last data length */
+static constexpr std::uint8_t special_i = new_s | new_w | new_u;
+/* Unidirectional data: seq advances by last data length */
+static constexpr std::uint8_t special_d = new_s | new_a | new_w | new_u;
+
+/* Largest IP + TCP header kept per slot */
+static constexpr std::size_t max_header = 128;
+
+/* Largest compressed header */
+static constexpr std::size_t max_compressed = 1 + 1 + 2 + 7 * 3;
+
+static constexpr std::size_t max_slots = 256;
+
+enum Type {
+	/* Not compressible, send as-is */
+	type_ip,
+	/* Send as-is, tagged with slot, to (re)establish the slot */
+	type_uncompressed,
+	/* Send compressed header followed by payload */
+	type_compressed
+};
+
+namespace detail {
+
+struct Slot
+{
+	std::uint8_t header[max_header];
+	std::size_t header_size{0};
+};
+
+inline bool is_tcp_v4(const std::uint8_t *packet, std::size_t size, std::size_t& ip_size, std::size_t& header_size)
+{
+	if (size < 40 || packet[0] >> 4 != 4 || packet[9] != IpHeader::proto_tcp) {
+		return false;
+	}
+	ip_size = (packet[0] & 0x0f) * 4;
+	if (ip_size < 20 || size < ip_size + 20) {
+		return false;
+	}
+	header_size = ip_size + (packet[ip_size + 12] >> 4) * 4;
+	return header_size >= ip_size + 20 && header_size <= size && header_size <= max_header;
+}
+
+/* Whether TCP options are exactly NOP, NOP, timestamps (the usual layout) */
+inline bool has_timestamps(const std::uint8_t *th, std::size_t options_size)
+{
+	return options_size == 12 && th[20] == 1 && th[21] == 1 && th[22] == 8 && th[23] == 10;
+}
+
+/* Value 1-255 in one byte, anything else as a zero byte and 16 bits */
+inline std::uint8_t *encode(std::uint8_t *p, std::uint32_t value)
+{
+	if (value == 0 || value >= 256) {
+		*p++ = 0;
+		IpHeader::store16(p, value);
+		return p + 2;
+	}
+	*p++ = value;
+	return p;
+}
+
+/* Returns false if out of input */
+inline bool decode(const std::uint8_t *& p, const std::uint8_t *end, std::uint32_t& value)
+{
+	if (p == end) {
+		return false;
+	}
+	if (*p != 0) {
+		value = *p++;
+		return true;
+	}
+	if (end - p < 3) {
+		return false;
+	}
+	value = IpHeader::load16(p + 1);
+	p += 3;
+	return true;
+}
+
+}
+
+class Compressor
+{
+	std::vector<detail::Slot> slots;
+	/* Slot indices, most recently used first */
+	std::vector<std::uint8_t> lru;
+	/* Slot of last compressed packet sent, so it need not be repeated */
+	int last_slot{-1};
+
+	/* Finds slot of packet's connection, or recycles the least recently used */
+	bool lookup(const std::uint8_t *packet, std::size_t ip_size, std::size_t& index)
+	{
+		for (std::size_t i = 0; i < lru.size(); i++) {
+			const auto& slot = slots[lru[i]];
+			const auto saved_ip_size = (slot.header[0] & 0x0f) * 4;
+			if (slot.header_size > 0 &&
+					std::memcmp(&slot.header[12], &packet[12], 8) == 0 &&
+					std::memcmp(&slot.header[saved_ip_size], &packet[ip_size], 4) == 0) {
+				index = lru[i];
+				std::memmove(&lru[1], &lru[0], i);
+				lru[0] = index;
+				return true;
+			}
+		}
+		index = lru.back();
+		std::memmove(&lru[1], &lru[0], lru.size() - 1);
+		lru[0] = index;
+		return false;
+	}
+
+public:
+	explicit Compressor(std::size_t slot_count) :
+		slots(slot_count),
+		lru(slot_count)
+	{
+		reset();
+	}
+
+	void reset()
+	{
+		for (std::size_t i = 0; i < slots.size(); i++) {
+			slots[i].header_size = 0;
+			lru[i] = i;
+		}
+		last_slot = -1;
+	}
+
+	/*
+	 * Decides how to send packet.  For type_compressed, the first
+	 * header_size bytes of the packet are to be replaced with the out_size
+	 * bytes written to out (max_compressed).  For type_uncompressed, slot is
+	 * the slot to tag the packet with.
+	 */
+	Type compress(const std::uint8_t *packet, std::size_t size, std::uint8_t *out, std::size_t& out_size, std::size_t& header_size, std::uint8_t& slot_id)
+	{
+		using namespace IpHeader;
+		std::size_t ip_size;
+		if (!detail::is_tcp_v4(packet, size, ip_size, header_size)) {
+			return type_ip;
+		}
+		const std::uint8_t *th = packet + ip_size;
+		const std::uint8_t flags = th[13];
+		/* Fragments, and connection setup/teardown, are never compressed */
+		if ((load16(packet + 6) & 0x3fff) || (flags & (tcp_syn | tcp_fin | tcp_rst)) || !(flags & tcp_ack)) {
+			return type_ip;
+		}
+
+		std::size_t index;
+		const bool found = lookup(packet, ip_size, index);
+		auto& slot = slots[index];
+		slot_id = index;
+		const auto save = [&] () {
+			std::memcpy(slot.header, packet, header_size);
+			slot.header_size = header_size;
+		};
+		if (!found) {
+			save();
+			last_slot = index;
+			return type_uncompressed;
+		}
+
+		const std::uint8_t *oip = slot.header;
+		const std::uint8_t *oth = slot.header + ip_size;
+		const std::size_t options_size = header_size - ip_size - 20;
+		const bool timestamps = detail::has_timestamps(th, options_size);
+		/* Anything changed which is not delta-encoded: version, TOS, fragment, TTL, options */
+		if (slot.header_size != header_size ||
+				load16(packet) != load16(oip) ||
+				std::memcmp(packet + 6, oip + 6, 4) != 0 ||
+				std::memcmp(packet + 20, oip + 20, ip_size - 20) != 0 ||
+				std::memcmp(th + 20, oth + 20, timestamps ? 4 : options_size) != 0) {
+			save();
+			last_slot = index;
+			return type_uncompressed;
+		}
+
+		std::uint8_t deltas[max_compressed];
+		std::uint8_t *p = deltas;
+		std::uint8_t changes = 0;
+
+		if (flags & tcp_urg) {
+			p = detail::encode(p, load16(th + 18));
+			changes |= new_u;
+		} else if (load16(th + 18) != load16(oth + 18)) {
+			save();
+			last_slot = index;
+			return type_uncompressed;
+		}
+		if (const std::uint16_t delta = load16(th + 14) - load16(oth + 14)) {
+			p = detail::encode(p, delta);
+			changes |= new_w;
+		}
+		const std::uint32_t delta_a = load32(th + 8) - load32(oth + 8);
+		if (delta_a) {
+			if (delta_a > 0xffff) {
+				save();
+				last_slot = index;
+				return type_uncompressed;
+			}
+			p = detail::encode(p, delta_a);
+			changes |= new_a;
+		}
+		const std::uint32_t delta_s = load32(th + 4) - load32(oth + 4);
+		if (delta_s) {
+			if (delta_s > 0xffff) {
+				save();
+				last_slot = index;
+				return type_uncompressed;
+			}
+			p = detail::encode(p, delta_s);
+			changes |= new_s;
+		}
+
+		/* Length of previous packet's data */
+		const std::uint32_t last_data = load16(oip + 2) - header_size;
+		switch (changes) {
+		case 0:
+			/* Retransmission or keepalive, unless first data after a pure ACK */
+			if (load16(packet + 2) != load16(oip + 2) && last_data == 0) {
+				break;
+			}
+			/* Fall through */
+		case special_i:
+		case special_d:
+			/* Real changes which look like a special case */
+			save();
+			last_slot = index;
+			return type_uncompressed;
+		case new_s | new_a:
+			if (delta_s == delta_a && delta_s == last_data) {
+				changes = special_i;
+				p = deltas;
+			}
+			break;
+		case new_s:
+			if (delta_s == last_data) {
+				changes = special_d;
+				p = deltas;
+			}
+			break;
+		}
+
+		if (const std::uint16_t delta = load16(packet + 4) - load16(oip + 4); delta != 1) {
+			p = detail::encode(p, delta);
+			changes |= new_i;
+		}
+		if (timestamps && std::memcmp(th + 24, oth + 24, 8) != 0) {
+			const std::uint32_t delta_tsval = load32(th + 24) - load32(oth + 24);
+			const std::uint32_t delta_tsecr = load32(th + 28) - load32(oth + 28);
+			if (delta_tsval > 0xffff || delta_tsecr > 0xffff) {
+				save();
+				last_slot = index;
+				return type_uncompressed;
+			}
+			p = detail::encode(p, delta_tsval);
+			p = detail::encode(p, delta_tsecr);
+			changes |= new_t;
+		}
+		if (flags & tcp_psh) {
+			changes |= tcp_push;
+		}
+		save();
+
+		std::uint8_t *o = out;
+		if (int(index) != last_slot) {
+			*o++ = changes | new_c;
+			*o++ = index;
+			last_slot = index;
+		} else {
+			*o++ = changes;
+		}
+		/* TCP checksum is passed through, the far end cannot recompute it */
+		*o++ = th[16];
+		*o++ = th[17];
+		std::memcpy(o, deltas, p - deltas);
+		o += p - deltas;
+		out_size = o - out;
+		return type_compressed;
+	}
+};
+
+class Decompressor
+{
+	std::vector<detail::Slot> slots;
+	std::size_t last_slot{0};
+	/* Frames were lost: drop compressed packets until one names its slot */
+	bool tossing{true};
+
+public:
+	explicit Decompressor(std::size_t slot_count) :
+		slots(slot_count)
+	{
+	}
+
+	void reset()
+	{
+		for (auto& slot : slots) {
+			slot.header_size = 0;
+		}
+		tossing = true;
+	}
+
+	/* Called when a frame has been lost or corrupted */
+	void toss()
+	{
+		tossing = true;
+	}
+
+	/* Records header of an uncompressed packet, returns false if unusable */
+	bool remember(std::uint8_t slot_id, const std::uint8_t *packet, std::size_t size)
+	{
+		std::size_t ip_size;
+		std::size_t header_size;
+		if (slot_id >= slots.size() || !detail::is_tcp_v4(packet, size, ip_size, header_size)) {
+			tossing = true;
+			return false;
+		}
+		auto& slot = slots[slot_id];
+		std::memcpy(slot.header, packet, header_size);
+		slot.header_size = header_size;
+		last_slot = slot_id;
+		tossing = false;
+		return true;
+	}
+
+	/*
+	 * Rebuilds header of a compressed packet into header (max_header bytes),
+	 * returns its size, or zero if the packet must be dropped.  consumed is
+	 * set to the size of the compressed header, the payload follows it.
+	 */
+	std::size_t decompress(const std::uint8_t *in, std::size_t size, std::uint8_t *header, std::size_t& consumed)
+	{
+		using namespace IpHeader;
+		const std::uint8_t *p = in;
+		const std::uint8_t *end = in + size;
+		if (p == end) {
+			return 0;
+		}
+		const std::uint8_t changes = *p++;
+		if (changes & new_c) {
+			if (p == end || *p >= slots.size() || slots[*p].header_size == 0) {
+				tossing = true;
+				return 0;
+			}
+			last_slot = *p++;
+			tossing = false;
+		} else if (tossing) {
+			return 0;
+		}
+		auto& slot = slots[last_slot];
+		if (slot.header_size == 0 || end - p < 2) {
+			tossing = true;
+			return 0;
+		}
+		/* Decoded into the output, the slot only takes it once every field has been read */
+		std::memcpy(header, slot.header, slot.header_size);
+		std::uint8_t *ip = header;
+		const std::size_t ip_size = (ip[0] & 0x0f) * 4;
+		std::uint8_t *th = ip + ip_size;
+		th[16] = *p++;
+		th[17] = *p++;
+		th[13] = (changes & tcp_push) ? (th[13] | tcp_psh) : (th[13] & ~tcp_psh);
+
+		const std::uint32_t last_data = load16(ip + 2) - slot.header_size;
+		std::uint32_t value = 0;
+		const auto next = [&] () {
+			if (detail::decode(p, end, value)) {
+				return true;
+			}
+			tossing = true;
+			return false;
+		};
+		switch (changes & specials_mask) {
+		case special_i:
+			store32(th + 8, load32(th + 8) + last_data);
+			store32(th + 4, load32(th + 4) + last_data);
+			break;
+		case special_d:
+			store32(th + 4, load32(th + 4) + last_data);
+			break;
+		default:
+			if (changes & new_u) {
+				if (!next()) {
+					return 0;
+				}
+				th[13] |= tcp_urg;
+				store16(th + 18, value);
+			} else {
+				th[13] &= ~tcp_urg;
+			}
+			if (changes & new_w) {
+				if (!next()) {
+					return 0;
+				}
+				store16(th + 14, load16(th + 14) + value);
+			}
+			if (changes & new_a) {
+				if (!next()) {
+					return 0;
+				}
+				store32(th + 8, load32(th + 8) + value);
+			}
+			if (changes & new_s) {
+				if (!next()) {
+					return 0;
+				}
+				store32(th + 4, load32(th + 4) + value);
+			}
+			break;
+		}
+		if (!(changes & new_i)) {
+			value = 1;
+		} else if (!next()) {
+			return 0;
+		}
+		store16(ip + 4, load16(ip + 4) + value);
+		if (changes & new_t) {
+			if (!detail::has_timestamps(th, slot.header_size - ip_size - 20) || !next()) {
+				tossing = true;
+				return 0;
+			}
+			store32(th + 24, load32(th + 24) + value);
+			if (!next()) {
+				return 0;
+			}
+			store32(th + 28, load32(th + 28) + value);
+		}
+
+		consumed = p - in;
+		store16(ip + 2, slot.header_size + (end - p));
+		store16(ip + 10, 0);
+		store16(ip + 10, ipv4_checksum(ip, ip_size));
+		std::memcpy(slot.header, header, slot.header_size);
+		return slot.header_size;
+	}
+};
+
+}
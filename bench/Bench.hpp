@@ -0,0 +1,22 @@
+#pragma once
+
+/*
+ * Microbenchmarks, built by "make bench" into bin/iplink-bench and run by
+ * name, see bench/Main.cpp
+ */
+
+#include <ostream>
+#include <string>
+
+namespace Bench {
+
+/* KISS decoder: byte-wise state machine against the vectorised contiguous path */
+void kiss_decoder(std::ostream& os);
+
+/* Epoll event dispatch: the old map-based wait() against the flat binding table */
+void epoll_dispatch(std::ostream& os);
+
+/* UDP/IP header compression ratio over a pcap capture, or synthetic telemetry if none */
+void iphc_compression(std::ostream& os, const std::string& capture);
+
+}
@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Iphc.hpp"
+
+#include "Bench.hpp"
+
+namespace Bench {
+
+using Packets = std::vector<std::vector<std::uint8_t>>;
+
+/* IP packets from a pcap file (raw IP, Ethernet or Linux cooked captures) */
+static Packets load_capture(const std::string& path)
+{
+	Packets packets;
+	std::ifstream is(path, std::ios::binary);
+	const std::vector<std::uint8_t> file{std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>()};
+	if (file.size() < 24) {
+		return packets;
+	}
+	const auto magic = IpHeader::load32(&file[0]);
+	const bool swapped = magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1;
+	if (!swapped && magic != 0xa1b2c3d4 && magic != 0xa1b23c4d) {
+		return packets;
+	}
+	const auto load = [&] (std::size_t offset) {
+		const auto value = IpHeader::load32(&file[offset]);
+		return swapped ? __builtin_bswap32(value) : value;
+	};
+	std::size_t link_size;
+	switch (load(20)) {
+	case 1: link_size = 14; break;
+	case 113: link_size = 16; break;
+	case 276: link_size = 20; break;
+	case 101: case 228: case 229: link_size = 0; break;
+	default: return packets;
+	}
+	for (std::size_t offset = 24; offset + 16 <= file.size(); ) {
+		const std::size_t size = load(offset + 8);
+		offset += 16;
+		if (offset + size > file.size()) {
+			break;
+		}
+		if (size > link_size) {
+			packets.emplace_back(&file[offset + link_size], &file[offset + size]);
+		}
+		offset += size;
+	}
+	return packets;
+}
+
+/* Sensors reporting small JSON readings over IPv4 and IPv6, some without UDP checksums */
+static Packets synthetic_telemetry(std::size_t count)
+{
+	using namespace IpHeader;
+	using Iphc::detail::udp_checksum;
+	Packets packets;
+	std::mt19937 rng(1);
+	constexpr int sensors = 12;
+	std::uint16_t ids[sensors] = {};
+	for (std::size_t n = 0; n < count; n++) {
+		const int sensor = rng() % sensors;
+		const bool v6 = sensor % 3 == 0;
+		const std::string json = "{\"id\":" + std::to_string(sensor) + ",\"t\":" + std::to_string(20000 + rng() % 500) + ",\"rh\":" + std::to_string(rng() % 100) + "}";
+		const std::size_t ip_size = v6 ? 40 : 20;
+		std::vector<std::uint8_t> p(ip_size + 8 + json.size());
+		std::uint8_t *udp = &p[ip_size];
+		if (v6) {
+			p[0] = 0x60;
+			store16(&p[4], 8 + json.size());
+			p[6] = proto_udp;
+			p[7] = 64;
+			p[8] = 0xfd;
+			p[23] = sensor + 1;
+			p[24] = 0xfd;
+			p[39] = 1;
+		} else {
+			p[0] = 0x45;
+			store16(&p[2], p.size());
+			store16(&p[4], ids[sensor]++);
+			store16(&p[6], 0x4000);
+			p[8] = 64;
+			p[9] = proto_udp;
+			store32(&p[12], 0x0a650002 + sensor);
+			store32(&p[16], 0x0a650001);
+			store16(&p[10], ipv4_checksum(&p[0], ip_size));
+		}
+		store16(udp, 40000 + sensor);
+		store16(udp + 2, 5683);
+		store16(udp + 4, 8 + json.size());
+		std::copy(json.begin(), json.end(), &p[ip_size + 8]);
+		if (v6 || sensor % 2 == 0) {
+			store16(udp + 6, udp_checksum(&p[0], ip_size + 8, &p[ip_size + 8], json.size()));
+		}
+		packets.push_back(std::move(p));
+	}
+	return packets;
+}
+
+/*
+ * Compression ratio and speed over a capture (or synthetic telemetry if none
+ * is given), checking every packet survives the round trip
+ */
+void iphc_compression(std::ostream& os, const std::string& capture)
+{
+	using namespace Iphc;
+
+	const auto packets = capture.empty() ? synthetic_telemetry(100000) : load_capture(capture);
+	if (packets.empty()) {
+		throw std::runtime_error("No IP packets read from capture: " + capture);
+	}
+
+	Compressor compressor(max_slots);
+	Decompressor decompressor(max_slots);
+	std::size_t udp_packets = 0;
+	std::size_t bytes_in = 0;
+	std::size_t bytes_out = 0;
+	std::size_t mismatches = 0;
+	std::vector<std::uint8_t> rebuilt;
+
+	using clock = std::chrono::steady_clock;
+	const auto t0 = clock::now();
+	for (const auto& packet : packets) {
+		std::uint8_t out[max_compressed];
+		std::uint8_t header[max_header];
+		std::size_t out_size = 0;
+		std::size_t header_size;
+		std::size_t consumed;
+		std::uint8_t slot;
+		const auto type = compressor.compress(packet.data(), packet.size(), out, out_size, header_size, slot);
+		if (type == type_ip) {
+			continue;
+		}
+		udp_packets++;
+		bytes_in += packet.size();
+		if (type == type_full) {
+			decompressor.remember(slot, packet.data(), packet.size());
+			bytes_out += 1 + packet.size();
+			continue;
+		}
+		bytes_out += out_size + packet.size() - header_size;
+		rebuilt.assign(out, out + out_size);
+		rebuilt.insert(rebuilt.end(), packet.begin() + header_size, packet.end());
+		const auto size = decompressor.decompress(rebuilt.data(), rebuilt.size(), header, consumed);
+		if (size != header_size || !std::equal(header, header + size, packet.begin())) {
+			mismatches++;
+		}
+	}
+	const double t = std::chrono::duration<double>(clock::now() - t0).count();
+
+	os << "packets: " << packets.size() << ", udp: " << udp_packets << std::endl;
+	os << "bytes: " << bytes_in << " -> " << bytes_out << " (" << 100.0 * bytes_out / std::max<std::size_t>(bytes_in, 1) << "%)" << std::endl;
+	os << "round trip: " << udp_packets / t / 1e6 << " M packets/s, " << mismatches << " mismatches" << std::endl;
+}
+
+}
@@ -0,0 +1,75 @@
+#include <chrono>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Kiss.hpp"
+
+#include "Bench.hpp"
+
+namespace Bench {
+
+/*
+ * Byte-wise state machine (iterator input) against the vectorised contiguous
+ * path, on random, text-like and escape-heavy payloads
+ */
+void kiss_decoder(std::ostream& os)
+{
+	using namespace Kiss;
+
+	constexpr std::size_t packet_size = 1500;
+	constexpr std::size_t packet_count = 4096;
+	constexpr int rounds = 10;
+
+	std::mt19937 rng(1);
+	const std::string text = "{\"sensor\": 12, \"temp\": 23.5, \"status\": \"ok\"}\n";
+
+	const auto make_stream = [&] (auto generate) {
+		Encoder encoder;
+		std::vector<std::uint8_t> packet(packet_size);
+		std::vector<std::uint8_t> stream;
+		auto oit = std::back_inserter(stream);
+		for (std::size_t i = 0; i < packet_count; i++) {
+			for (std::size_t j = 0; j < packet_size; j++) {
+				packet[j] = generate(j);
+			}
+			oit = encoder.open(oit);
+			oit = encoder.write(packet.data(), packet.size(), oit);
+			oit = encoder.close(oit);
+		}
+		return stream;
+	};
+
+	const auto run = [&] (const char *name, const std::vector<std::uint8_t>& stream) {
+		using clock = std::chrono::steady_clock;
+		std::size_t decoded = 0;
+		const auto sink = [&decoded] (const std::uint8_t *, std::size_t size) {
+			decoded += size;
+		};
+		Decoder scalar(packet_size);
+		Decoder vector(packet_size);
+		const auto t0 = clock::now();
+		for (int i = 0; i < rounds; i++) {
+			scalar.decode(stream.cbegin(), stream.cend(), sink);
+		}
+		const auto t1 = clock::now();
+		for (int i = 0; i < rounds; i++) {
+			vector.decode(stream.data(), stream.data() + stream.size(), sink);
+		}
+		const auto t2 = clock::now();
+		const double mb = double(stream.size()) * rounds / 1e6;
+		const double ts = std::chrono::duration<double>(t1 - t0).count();
+		const double tv = std::chrono::duration<double>(t2 - t1).count();
+		os << name << ": scalar " << mb / ts << " MB/s, vector " << mb / tv << " MB/s (" << ts / tv << "x)" << std::endl;
+	};
+
+	run("random", make_stream([&] (std::size_t) { return std::uint8_t(rng()); }));
+	run("text", make_stream([&] (std::size_t j) { return std::uint8_t(text[j % text.size()]); }));
+	run("escape-heavy", make_stream([&] (std::size_t) {
+		const auto r = rng() % 4;
+		return std::uint8_t(r == 0 ? Config::FEND : r == 1 ? Config::FESC : rng());
+	}));
+}
+
+}
@@ -0,0 +1,90 @@
+#include <chrono>
+#include <list>
+#include <map>
+
+#include "Linux.hpp"
+
+#include "Bench.hpp"
+
+namespace Bench {
+
+/*
+ * The per-call allocating, map-based loop which EpollFD::wait used to be,
+ * against wait() and dispatch() on the flat binding table.  All descriptors
+ * are permanently readable, so every iteration returns fd_count events.
+ */
+void epoll_dispatch(std::ostream& os)
+{
+	using namespace Linux;
+
+	constexpr int fd_count = 8;
+	constexpr int rounds = 200000;
+
+	/* Non-zero eventfds, never read, so always readable */
+	std::list<FileDescriptor> fds;
+	for (int i = 0; i < fd_count; i++) {
+		fds.emplace_back(eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC), "eventfd");
+	}
+
+	std::uint64_t calls = 0;
+	const auto handler = [&calls] (EpollFD::Events) {
+		calls++;
+	};
+
+	const auto run = [&] (const char *name, auto iterate) {
+		using clock = std::chrono::steady_clock;
+		calls = 0;
+		const auto t0 = clock::now();
+		for (int i = 0; i < rounds; i++) {
+			iterate();
+		}
+		const double t = std::chrono::duration<double>(clock::now() - t0).count();
+		os << name << ": " << calls / t / 1e6 << " M events/s" << std::endl;
+	};
+
+	/* What wait() used to do */
+	{
+		EpollFD epfd;
+		std::map<int, EpollFD::Handler> handlers;
+		for (const auto& fd : fds) {
+			handlers[fd.get_fd()] = handler;
+			epoll_event ee;
+			ee.events = EPOLLIN;
+			ee.data.fd = fd.get_fd();
+			detail::assert_zero("epoll_ctl", epoll_ctl(epfd.get_fd(), EPOLL_CTL_ADD, fd.get_fd(), &ee));
+		}
+		run("legacy", [&] () {
+			std::vector<epoll_event> events;
+			events.resize(fd_count);
+			auto count = epoll_wait(epfd.get_fd(), events.data(), events.size(), -1);
+			events.resize(count);
+			for (const auto& event : events) {
+				handlers.at(event.data.fd)(EpollFD::Events(event.events));
+			}
+		});
+	}
+
+	{
+		EpollFD epfd;
+		for (const auto& fd : fds) {
+			epfd.bind(fd, handler, EpollFD::event_in);
+		}
+		run("wait", [&] () {
+			epfd.wait(fd_count);
+		});
+	}
+
+	{
+		EpollFD epfd;
+		for (const auto& fd : fds) {
+			epfd.bind_id(fd, fd.get_fd(), EpollFD::event_in);
+		}
+		run("dispatch", [&] () {
+			epfd.dispatch([&calls] (std::uint64_t, EpollFD::Events) {
+				calls++;
+			}, fd_count);
+		});
+	}
+}
+
+}
@@ -0,0 +1,22 @@
+#include <iostream>
+#include <string>
+
+#include "Bench.hpp"
+
+/*** Benchmark runner ***/
+
+int main(int argc, char *argv[])
+{
+	const std::string name = argc > 1 ? argv[1] : "";
+	if (name == "kiss") {
+		Bench::kiss_decoder(std::cout);
+	} else if (name == "epoll") {
+		Bench::epoll_dispatch(std::cout);
+	} else if (name == "iphc") {
+		Bench::iphc_compression(std::cout, argc > 2 ? argv[2] : "");
+	} else {
+		std::cerr << "usage: " << argv[0] << " kiss | epoll | iphc [capture.pcap]" << std::endl;
+		return 1;
+	}
+	return 0;
+}
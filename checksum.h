@@ -2,4 +2,9 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#define CHECKSUM_INIT 0xaaaaaaaaUL
+
 uint32_t calc_checksum(const void *buf, size_t len);
+
+/* Continue checksum "cs" of the first "offset" bytes over a further buffer */
+uint32_t calc_checksum_update(uint32_t cs, size_t offset, const void *buf, size_t len);
@@ -0,0 +1,102 @@
+#include <string.h>
+
+#if defined __x86_64__ || defined __i386__
+#include <nmmintrin.h>
+#define CRC32C_X86
+#endif
+
+#include "crc32c.h"
+
+/* Reflected Castagnoli polynomial */
+#define POLY 0x82f63b78UL
+
+static uint32_t table[8][256];
+
+static uint32_t crc32c_sw(uint32_t crc, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	uint32_t c = ~crc;
+	/* Slicing-by-8: eight table lookups per 64-bit word */
+	for (; len >= 8; len -= 8, p += 8) {
+		uint32_t lo;
+		uint32_t hi;
+		memcpy(&lo, p, 4);
+		memcpy(&hi, p + 4, 4);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		lo = __builtin_bswap32(lo);
+		hi = __builtin_bswap32(hi);
+#endif
+		lo ^= c;
+		c = table[7][lo & 0xff] ^
+			table[6][(lo >> 8) & 0xff] ^
+			table[5][(lo >> 16) & 0xff] ^
+			table[4][lo >> 24] ^
+			table[3][hi & 0xff] ^
+			table[2][(hi >> 8) & 0xff] ^
+			table[1][(hi >> 16) & 0xff] ^
+			table[0][hi >> 24];
+	}
+	for (; len; len--, p++) {
+		c = table[0][(c ^ *p) & 0xff] ^ (c >> 8);
+	}
+	return ~c;
+}
+
+#if defined CRC32C_X86
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+#if defined __x86_64__
+	uint64_t c = ~crc;
+	for (; len >= 8; len -= 8, p += 8) {
+		uint64_t word;
+		memcpy(&word, p, sizeof(word));
+		c = _mm_crc32_u64(c, word);
+	}
+#else
+	uint32_t c = ~crc;
+	for (; len >= 4; len -= 4, p += 4) {
+		uint32_t word;
+		memcpy(&word, p, sizeof(word));
+		c = _mm_crc32_u32(c, word);
+	}
+#endif
+	for (; len; len--, p++) {
+		c = _mm_crc32_u8(c, *p);
+	}
+	return ~(uint32_t) c;
+}
+
+#endif
+
+static uint32_t (*crc32c_impl)(uint32_t crc, const void *buf, size_t len) = crc32c_sw;
+
+__attribute__((constructor))
+static void crc32c_init()
+{
+	for (int i = 0; i < 256; i++) {
+		uint32_t c = i;
+		for (int j = 0; j < 8; j++) {
+			c = c & 1 ? (c >> 1) ^ POLY : c >> 1;
+		}
+		table[0][i] = c;
+	}
+	for (int i = 0; i < 256; i++) {
+		for (int k = 1; k < 8; k++) {
+			table[k][i] = table[0][table[k - 1][i] & 0xff] ^ (table[k - 1][i] >> 8);
+		}
+	}
+#if defined CRC32C_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.2")) {
+		crc32c_impl = crc32c_hw;
+	}
+#endif
+}
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len)
+{
+	return crc32c_impl(crc, buf, len);
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * CRC-32C (Castagnoli), using SSE4.2 instructions when the CPU supports them
+ * and slicing-by-8 tables otherwise.
+ *
+ * Incremental: pass 0 to start, or the previous result to continue.
+ */
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
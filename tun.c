@@ -20,7 +20,7 @@
 static const char *tundev = "/dev/net/tun";
 
 /* Initialise a TUN instance */
-int tun_fd(const char *dev, char *dev_out, int flags)
+int tun_fd(const char *dev, char *dev_out, int flags, bool no_pi)
 {
 	int fd = open(tundev, O_RDWR | flags);
 	if (fd < 0) {
@@ -30,7 +30,7 @@ int tun_fd(const char *dev, char *dev_out, int flags)
 
 	struct ifreq ifr;
 	memset(&ifr, 0, sizeof(ifr));
-	ifr.ifr_flags = IFF_TUN;
+	ifr.ifr_flags = IFF_TUN | (no_pi ? IFF_NO_PI : 0);
 	if (dev) {
 		strncpy(ifr.ifr_name, dev, IFNAMSIZ);
 	}
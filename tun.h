@@ -1,5 +1,6 @@
 #pragma once
 #include <stdint.h>
+#include <stdbool.h>
 
 /* Structures to represent data read from TUN */
 struct __attribute__((__packed__)) tun_frame_info
@@ -14,5 +15,5 @@ struct __attribute__((__packed__)) tun_frame
 	uint8_t data[];
 };
 
-/* Initialise a TUN instance */
-int tun_fd(const char *dev, char *dev_out, int flags);
+/* Initialise a TUN instance, without tun_frame_info on packets if no_pi */
+int tun_fd(const char *dev, char *dev_out, int flags, bool no_pi);